@@ -0,0 +1,81 @@
+/*============================================================================
+
+  bitmapfb.h
+
+  A bitmap whose pixels are in the same format as the framebuffer's --
+  RGB565, or three or four bytes -- so that it can be copied to the
+  framebuffer without any conversion, a row at a time. Every row
+  starts on a 64-byte boundary (so on a cache line, and suitably for
+  any vector load), with padding at the end to make it so.
+
+  It suits anything that is drawn or converted once and shown many
+  times, or that is drawn in a way that does not need to read the
+  pixels back as b,g,r. A BitmapRGB can be converted to it, rectangle
+  by rectangle.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <klib/defs.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include <klib/kthreadpool.h>
+
+struct _BitmapFB;
+typedef struct _BitmapFB BitmapFB;
+
+BEGIN_DECLS
+
+/** Create a new, black, bitmap of w x h pixels of bits_per_pixel
+    bits, which may be 16 (taken to be RGB565), 24 or 32. Returns NULL
+    if there is not enough memory for its pixels. */
+BitmapFB    *bitmapfb_create (int w, int h, int bits_per_pixel);
+/** Create a new, black, bitmap the same size and format as a
+    framebuffer, which must already be initialized. Returns NULL if
+    there is not enough memory. */
+BitmapFB    *bitmapfb_create_for_fb (const FrameBuffer *fb);
+void         bitmapfb_destroy (BitmapFB *self);
+
+int          bitmapfb_get_width (const BitmapFB *self);
+int          bitmapfb_get_height (const BitmapFB *self);
+int          bitmapfb_get_bits_per_pixel (const BitmapFB *self);
+/** Get the number of bytes from the start of one row to the start of
+    the next, which is a multiple of 64. */
+int          bitmapfb_get_stride (const BitmapFB *self);
+/** Get the pixel data, which starts on a 64-byte boundary. */
+BYTE        *bitmapfb_get_data (BitmapFB *self);
+
+/** Copy another bitmap, which must have the same size and format. */
+void         bitmapfb_copy_from (BitmapFB *self, const BitmapFB *other);
+
+/** Set all pixels to the same colour. */
+void         bitmapfb_clear (BitmapFB *self, BYTE r, BYTE g, BYTE b);
+/** Set all the pixels from x1,y1 up to, but not including, x2,y2. */
+void         bitmapfb_fill_rect (BitmapFB *self, int x1, int y1,
+                int x2, int y2, BYTE r, BYTE g, BYTE b);
+
+/** Convert the rectangle x,y (w x h) of a BitmapRGB to the same place
+    in this bitmap, reducing the colours as specified if this bitmap
+    has fewer than 24 bits per pixel. The parts of the rectangle that
+    fall outside either bitmap are ignored. */
+void         bitmapfb_from_bitmaprgb (BitmapFB *self, const BitmapRGB *src,
+                int x, int y, int w, int h, BitmapRGBDither dither);
+/** As bitmapfb_from_bitmaprgb(), shared between the threads of a pool,
+    except for error diffusion, which is done in one piece. The result
+    is the same. */
+void         bitmapfb_from_bitmaprgb_tiled (BitmapFB *self, 
+                const BitmapRGB *src, int x, int y, int w, int h, 
+                BitmapRGBDither dither, KThreadPool *pool);
+
+/** Copy the rectangle x,y (w x h) of this bitmap to the same place on
+    the framebuffer, which must have the same number of bits per
+    pixel. The parts of the rectangle that fall outside either are
+    ignored. */
+void         bitmapfb_to_fb_rect (const BitmapFB *self, FrameBuffer *fb,
+                int x, int y, int w, int h);
+
+END_DECLS
+
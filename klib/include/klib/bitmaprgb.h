@@ -9,42 +9,243 @@
 
 #include <klib/defs.h>
 #include <klib/framebuffer.h>
+#include <klib/kthreadpool.h>
 
 struct _BitmapRGB;
 typedef struct _BitmapRGB BitmapRGB;
 
+// How bitmaprgb_scale_into() works out each output pixel
+typedef enum 
+  {
+  // Copy the nearest source pixel. Fastest, but blocky
+  BITMAPRGB_FILTER_BOX = 0,
+  // Interpolate between the four nearest source pixels. Smooth when
+  //   enlarging, but loses detail when reducing by more than half
+  BITMAPRGB_FILTER_BILINEAR,
+  // Average all the source pixels that the output pixel covers. The
+  //   best choice for reducing photos
+  BITMAPRGB_FILTER_AREA
+  } BitmapRGBFilter;
+
+// How bitmaprgb_scale_into() fits the image to the bitmap. All these
+//   keep the image's aspect ratio
+typedef enum
+  {
+  // As large as possible while showing all the image, centred. The
+  //   rest of the bitmap is left as it was
+  BITMAPRGB_SCALE_FIT = 0,
+  // As FIT, but the rest of the bitmap is made black
+  BITMAPRGB_SCALE_LETTERBOX,
+  // Cover the whole bitmap, cutting off the edges of the image
+  BITMAPRGB_SCALE_FILL
+  } BitmapRGBScaleMode;
+
+// A change of orientation. Rotations are clockwise
+typedef enum
+  {
+  BITMAPRGB_TRANSFORM_NONE = 0,
+  BITMAPRGB_TRANSFORM_ROTATE_90,
+  BITMAPRGB_TRANSFORM_ROTATE_180,
+  BITMAPRGB_TRANSFORM_ROTATE_270,
+  // Mirror left-to-right
+  BITMAPRGB_TRANSFORM_FLIP_H,
+  // Mirror top-to-bottom
+  BITMAPRGB_TRANSFORM_FLIP_V
+  } BitmapRGBTransform;
+
+// How colours are reduced, when copying to a framebuffer with fewer 
+//   than 24 bits per pixel. On deeper framebuffers, there is nothing to
+//   reduce, and all these are the same
+typedef enum
+  {
+  // Drop the low bits. Fastest, and exact for an image that was read 
+  //   from the same framebuffer, but smooth shading shows bands
+  BITMAPRGB_DITHER_NONE = 0,
+  // Add a fixed pattern of small offsets (8x8 Bayer) before dropping
+  //   the low bits. Nearly as fast, and hides banding
+  BITMAPRGB_DITHER_ORDERED,
+  // Carry each pixel's error into its neighbours (Floyd-Steinberg). 
+  //   Slower, but the best quality for still images
+  BITMAPRGB_DITHER_DIFFUSION
+  } BitmapRGBDither;
+
+// A line for bitmaprgb_draw_lines()
+typedef struct _BitmapRGBLine
+  {
+  int x1, y1, x2, y2;
+  BYTE r, g, b;
+  } BitmapRGBLine;
+
+// A rectangle of pixels, as reported by bitmaprgb_get_damage()
+typedef struct _BitmapRGBRect
+  {
+  int x, y, w, h;
+  } BitmapRGBRect;
+
+// Most separate rectangles that damage tracking keeps. Changes beyond
+//   that are merged into the rectangles that grow least by taking them
+#define BITMAPRGB_MAX_DAMAGE 8
+
 BEGIN_DECLS
 
+/** Create a new, black, bitmap. Returns NULL if there is not enough
+    memory for its pixels. */
 BitmapRGB   *bitmaprgb_create (int w, int h);
 // Create from an existing memory buffer, which is copied locally
 BitmapRGB   *bitmaprgb_create_from_buff (int w, int h, const BYTE *buff);
+// Create using an existing memory buffer, which is not copied, and is
+//   not freed when the bitmap is destroyed. The buffer must hold 
+//   w * h pixels, each of three bytes in the order b,g,r
+BitmapRGB   *bitmaprgb_create_for_data (int w, int h, BYTE *data);
 void         bitmaprgb_destroy (BitmapRGB *self);
+/** Load an image file, whose format is determined from its contents.
+    Baseline JPEG, binary PPM (P6), uncompressed BMP, and QOI files
+    are supported. Returns NULL, and sets error (which the caller must
+    free) if the file can't be loaded. */
+BitmapRGB   *bitmaprgb_load (const char *file, char **error);
+/** As bitmaprgb_load(), for an image that will be scaled to fit
+    max_w x max_h. Formats that allow it (JPEG) are decoded at a
+    reduced size, when that is still no smaller than the image will
+    be shown. */
+BitmapRGB   *bitmaprgb_load_scaled (const char *file, int max_w, int max_h,
+               char **error);
 
 void         bitmaprgb_clear (BitmapRGB *self, BYTE r, BYTE g, BYTE b);
 void         bitmaprgb_set_pixel (BitmapRGB *self, int x, int y, 
                 BYTE r, BYTE g, BYTE b);
+/** Fill the rectangle between the corners x1,y1 and x2,y2, which 
+    is clipped to the bitmap. The pixels in column x2 and row y2 are
+    not filled. */
 void         bitmaprgb_fill_rect (BitmapRGB *self, int x1, int y1,
                 int x2, int y2, BYTE r, BYTE g, BYTE b);
+/** As bitmaprgb_fill_rect(), shared between the threads of a pool. */
+void         bitmaprgb_fill_rect_tiled (BitmapRGB *self, int x1, int y1,
+                int x2, int y2, BYTE r, BYTE g, BYTE b, KThreadPool *pool);
+/** As bitmaprgb_fill_rect(), but shading evenly from r1,g1,b1 at the 
+    left to r2,g2,b2 at the right. */
+void         bitmaprgb_fill_gradient (BitmapRGB *self, int x1, int y1,
+                int x2, int y2, BYTE r1, BYTE g1, BYTE b1, 
+                BYTE r2, BYTE g2, BYTE b2);
+/** As bitmaprgb_fill_rect(), but with a checkerboard of squares of 
+    size pixels, starting with r1,g1,b1 at the top-left corner. */
+void         bitmaprgb_fill_checker (BitmapRGB *self, int x1, int y1,
+                int x2, int y2, int size, BYTE r1, BYTE g1, BYTE b1, 
+                BYTE r2, BYTE g2, BYTE b2);
 
 /** Copy this bitmap to the framebuffer, starting at offset x,y */
 void         bitmaprgb_to_fb (const BitmapRGB *r, FrameBuffer *fb, 
                int x, int y);
 
+/** Copy the part of this bitmap that starts at x,y, and is w x h pixels,
+    to the same position on the framebuffer. The rectangle is clipped
+    to the bitmap and the framebuffer. */
+void         bitmaprgb_to_fb_rect (const BitmapRGB *self, FrameBuffer *fb,
+               int x, int y, int w, int h);
+
+/** As bitmaprgb_to_fb_rect(), reducing the colours as specified if the
+    framebuffer has fewer than 24 bits per pixel. */
+void         bitmaprgb_to_fb_rect_dithered (const BitmapRGB *self, 
+               FrameBuffer *fb, int x, int y, int w, int h, 
+               BitmapRGBDither dither);
+
+/** As bitmaprgb_to_fb_rect_dithered(), shared between the threads of 
+    a pool, except for error diffusion, which is done in one piece. 
+    The result is the same. */
+void         bitmaprgb_to_fb_rect_tiled (const BitmapRGB *self, 
+               FrameBuffer *fb, int x, int y, int w, int h, 
+               BitmapRGBDither dither, KThreadPool *pool);
+
+/** As bitmaprgb_to_fb_rect(), but with this bitmap rotated or flipped 
+    by transform, so that the transformed bitmap has its top-left
+    corner at the top-left of the framebuffer. x, y, w and h are in the
+    bitmap's own coordinates, before it is transformed. Colours are 
+    reduced as bitmaprgb_to_fb_rect_dithered(). */
+void         bitmaprgb_to_fb_rect_transformed (const BitmapRGB *self, 
+               FrameBuffer *fb, int x, int y, int w, int h, 
+               BitmapRGBTransform transform, BitmapRGBDither dither);
+
 /** Copy this bitmap from the framebuffer, starting at offset x,y */
 void         bitmaprgb_from_fb (BitmapRGB *self, const FrameBuffer *fb, 
                int x, int y);
+/** Darken to percent of the original brightness. */
 void         bitmaprgb_darken (BitmapRGB *self, int percent);
+/** Multiply each channel by the matching tint channel / 255, as if seen
+    through a filter of that colour. */
+void         bitmaprgb_tint (BitmapRGB *self, BYTE r, BYTE g, BYTE b);
+/** Replace each channel value v by 255 * (v / 255)^gamma, so that gamma
+    greater than 1 darkens the mid-tones, and less than 1 lightens them. */
+void         bitmaprgb_gamma (BitmapRGB *self, float gamma);
+/** Replace each pixel by a grey of the same brightness. */
+void         bitmaprgb_grayscale (BitmapRGB *self);
+/** Create a copy of another bitmap. Returns NULL if there is not
+    enough memory. */
 BitmapRGB   *bitmaprgb_clone (const BitmapRGB *other);
+/** Create a copy of another bitmap, rotated or flipped. A rotation by 90
+    or 270 degrees swaps the width and height. Returns NULL if there is
+    not enough memory. */
+BitmapRGB   *bitmaprgb_transform (const BitmapRGB *other, 
+               BitmapRGBTransform transform);
 int          bitmaprgb_get_height (const BitmapRGB *self);
 int          bitmaprgb_get_width (const BitmapRGB *self);
-void         bitmaprgb_draw_line_one_pixel (BitmapRGB *self, int x1, int x2, 
-                int y1, int y2, BYTE r, BYTE g, BYTE b);
+/** Get the pixel data: h rows of w pixels, each of three bytes in the
+    order b,g,r */
+BYTE        *bitmaprgb_get_data (BitmapRGB *self);
+/** Draw an anti-aliased line, one pixel wide, from x1,y1 to x2,y2. The
+    line is blended with what is already there, and clipped to the 
+    bitmap. */
+void         bitmaprgb_draw_line_one_pixel (BitmapRGB *self, int x1, int y1, 
+                int x2, int y2, BYTE r, BYTE g, BYTE b);
+/** Draw anti-aliased lines joining npoints points in turn. points holds
+    the x and y of each point. */
+void         bitmaprgb_draw_polyline (BitmapRGB *self, const int *points,
+                int npoints, BYTE r, BYTE g, BYTE b);
+/** Draw n anti-aliased lines, each as bitmaprgb_draw_line_one_pixel(). */
+void         bitmaprgb_draw_lines (BitmapRGB *self, 
+                const BitmapRGBLine *lines, int n);
 void         bitmaprgb_copy_from (BitmapRGB *self, const BitmapRGB *other);
+/** Copy the whole of another bitmap into this one, with its top-left 
+    corner at x,y. The parts that fall outside this bitmap are ignored. */
+void         bitmaprgb_blit (BitmapRGB *self, const BitmapRGB *other, 
+                int x, int y);
+/** Scale another bitmap into this one, which may be any size. */
+void         bitmaprgb_scale_into (BitmapRGB *self, const BitmapRGB *other,
+                BitmapRGBFilter filter, BitmapRGBScaleMode mode);
+/** As bitmaprgb_scale_into(), shared between the threads of a pool.
+    The result is the same. */
+void         bitmaprgb_scale_into_tiled (BitmapRGB *self, 
+                const BitmapRGB *other, BitmapRGBFilter filter, 
+                BitmapRGBScaleMode mode, KThreadPool *pool);
 
 
 void         bitmaprgb_get_pixel (BitmapRGB *self, int x, int y, 
                 BYTE *r, BYTE *g, BYTE *b);
 
+/** Start or stop recording which parts of this bitmap change. While
+    tracking, every function that draws on the bitmap adds the area it
+    drew on -- or, for a line, the rectangle that bounds it -- to a
+    short list of rectangles, merging those that are close together.
+    Changes made directly to the data are not seen, and must be added 
+    with bitmaprgb_add_damage(). Starting clears the list. */
+void         bitmaprgb_track_damage (BitmapRGB *self, BOOL track);
+/** Record that the rectangle x,y (w x h) has changed, if tracking. */
+void         bitmaprgb_add_damage (BitmapRGB *self, int x, int y, 
+                int w, int h);
+/** Get up to max of the changed rectangles, returning the number there
+    are, which is never more than BITMAPRGB_MAX_DAMAGE. */
+int          bitmaprgb_get_damage (const BitmapRGB *self, 
+                BitmapRGBRect *rects, int max);
+void         bitmaprgb_clear_damage (BitmapRGB *self);
+/** Copy just the changed rectangles to the same places on the 
+    framebuffer, as bitmaprgb_to_fb_rect_dithered(), and clear the
+    list. */
+void         bitmaprgb_present (BitmapRGB *self, FrameBuffer *fb,
+                BitmapRGBDither dither);
+/** As bitmaprgb_present(), but transformed as 
+    bitmaprgb_to_fb_rect_transformed(). */
+void         bitmaprgb_present_transformed (BitmapRGB *self, 
+                FrameBuffer *fb, BitmapRGBTransform transform, 
+                BitmapRGBDither dither);
+
 END_DECLS
 
 
@@ -0,0 +1,59 @@
+/*============================================================================
+
+  bitmaprgba.h
+
+  A bitmap with an alpha channel, for drawing things -- overlays, for
+  example -- that are to be laid over a BitmapRGB or the framebuffer,
+  letting what is underneath show through where they are transparent.
+
+  Colours are stored premultiplied by alpha, but the functions that
+  take a colour take it as it would be seen if it were opaque.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <klib/defs.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include <klib/kthreadpool.h>
+
+struct _BitmapRGBA;
+typedef struct _BitmapRGBA BitmapRGBA;
+
+BEGIN_DECLS
+
+/** Create a new bitmap, which is initially fully transparent. */
+BitmapRGBA  *bitmaprgba_create (int w, int h);
+void         bitmaprgba_destroy (BitmapRGBA *self);
+int          bitmaprgba_get_width (const BitmapRGBA *self);
+int          bitmaprgba_get_height (const BitmapRGBA *self);
+/** Get the pixel data: h rows of w pixels, each of four bytes in the
+    order b,g,r,a. b, g and r are premultiplied by a, and so must be 
+    no larger than it. */
+BYTE        *bitmaprgba_get_data (BitmapRGBA *self);
+
+/** Make the whole bitmap fully transparent. */
+void         bitmaprgba_clear (BitmapRGBA *self);
+/** Set a pixel, with an alpha of 0 (transparent) to 255 (opaque). */
+void         bitmaprgba_set_pixel (BitmapRGBA *self, int x, int y, 
+                BYTE r, BYTE g, BYTE b, BYTE a);
+/** Set all the pixels from x1,y1 up to, but not including, x2,y2. */
+void         bitmaprgba_fill_rect (BitmapRGBA *self, int x1, int y1,
+                int x2, int y2, BYTE r, BYTE g, BYTE b, BYTE a);
+
+/** Lay this bitmap over another, with its top-left corner at x,y. The
+    parts that fall outside the other bitmap are ignored. */
+void         bitmaprgba_over (const BitmapRGBA *self, BitmapRGB *dest,
+                int x, int y);
+/** As bitmaprgba_over(), shared between the threads of a pool. */
+void         bitmaprgba_over_tiled (const BitmapRGBA *self, BitmapRGB *dest,
+                int x, int y, KThreadPool *pool);
+/** As bitmaprgba_over(), but drawing directly on the framebuffer. */
+void         bitmaprgba_over_fb (const BitmapRGBA *self, FrameBuffer *fb,
+                int x, int y);
+
+END_DECLS
+
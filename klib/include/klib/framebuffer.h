@@ -57,6 +57,15 @@ int              framebuffer_get_width (const FrameBuffer *self);
     initialized first. */
 int              framebuffer_get_height (const FrameBuffer *self);
 
+/** Get the number of bits per pixel. 16 (taken to be RGB565), 24 and 32
+    are supported. The FB must be initialized first. */
+int              framebuffer_get_bits_per_pixel (const FrameBuffer *self);
+
+/** Get the number of bytes from the start of one row of the data area
+    to the start of the next, which may be more than the width times
+    the bytes per pixel. The FB must be initialized first. */
+int              framebuffer_get_stride (const FrameBuffer *self);
+
 /** Get the RGB colour values of a specific pixel. */
 void             framebuffer_get_pixel (const FrameBuffer *self, 
                       int x, int y, BYTE *r, BYTE *g, BYTE *b);
@@ -69,5 +78,12 @@ BYTE            *framebuffer_get_data (FrameBuffer *self);
 /** Set the whole framebuffer to black. */
 void             framebuffer_clear (FrameBuffer *self);
 
+/** Change the tone of everything on the framebuffer, in place. These
+    work as the bitmaprgb_ functions of the same names. */
+void             framebuffer_darken (FrameBuffer *self, int percent);
+void             framebuffer_tint (FrameBuffer *self, BYTE r, BYTE g, BYTE b);
+void             framebuffer_gamma (FrameBuffer *self, float gamma);
+void             framebuffer_grayscale (FrameBuffer *self);
+
 END_DECLS
 
@@ -25,6 +25,9 @@
 #include <klib/kterminal.h>
 #include <klib/klinux_terminal.h>
 #include <klib/numberformat.h>
+#include <klib/kthreadpool.h>
 #include <klib/framebuffer.h>
 #include <klib/bitmaprgb.h>
+#include <klib/bitmaprgba.h>
+#include <klib/bitmapfb.h>
 
@@ -0,0 +1,57 @@
+/*============================================================================
+
+  kthreadpool.h
+
+  A fixed set of threads that share out the tasks of a job between
+  them. A job is a number of tasks, numbered from zero, all done by
+  the same function; the thread that runs the job does its share of
+  them as well, and the call returns when they are all finished.
+
+  Each thread starts with its own run of consecutive tasks, and one
+  that runs out takes half of what is left of another's, so the work
+  evens out even when some tasks take longer than others. Tasks must
+  therefore not depend on one another, or on the order in which they
+  are done.
+
+  A pool of one thread starts no threads at all, and does the tasks
+  in order, on the thread that runs the job -- exactly as a plain loop
+  would, which is the thing to use when debugging or profiling. Every
+  function that takes a pool also accepts NULL, meaning the same.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <klib/defs.h>
+
+struct _KThreadPool;
+typedef struct _KThreadPool KThreadPool;
+
+// A task of a job. arg is the argument given to kthreadpool_run(), and
+//   index the number of the task
+typedef void (*KThreadPoolTask) (void *arg, int index);
+
+BEGIN_DECLS
+
+/** Create a pool of the specified number of threads, including the
+    one that will run the jobs, or one for each CPU if threads is
+    zero or less. If threads can't be started, the pool has as many
+    as could be. */
+KThreadPool *kthreadpool_create (int threads);
+/** Stop the threads, and free everything. No job may be running. */
+void         kthreadpool_destroy (KThreadPool *self);
+
+/** Get the number of threads, including the one that runs the jobs.
+    Returns 1 if self is NULL. */
+int          kthreadpool_get_threads (const KThreadPool *self);
+
+/** Do the tasks numbered 0 to n-1, returning when all are finished.
+    Jobs run from different threads take turns, but a task must not
+    run a job on the same pool. */
+void         kthreadpool_run (KThreadPool *self, int n,
+                KThreadPoolTask task, void *arg);
+
+END_DECLS
+
@@ -0,0 +1,258 @@
+/*============================================================================
+
+  bitmapfb.c
+
+  The pixel formats are those of fb_format.c. Since every row is padded
+  to a multiple of 64 bytes, and the data is allocated on a 64-byte
+  boundary, copying a rectangle that spans the whole width copies
+  whole cache lines, and the rows of a framebuffer (whose line length
+  is almost always a multiple of 64 bytes as well) line up with them.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include <klib/bitmapfb.h>
+#include "bitmaprgb_private.h"
+#include "fb_format.h"
+
+#define KLOG_CLASS "klib.bitmapfb"
+
+// Rows, and the data as a whole, start on a multiple of this many bytes
+#define ALIGN 64
+
+struct _BitmapFB
+  {
+  int w;
+  int h;
+  int bytes_pp; // 2, 3 or 4
+  int stride; // Bytes from one row to the next; a multiple of ALIGN
+  BYTE *data;
+  };
+
+/*==========================================================================
+  bitmapfb_create
+*==========================================================================*/
+BitmapFB *bitmapfb_create (int w, int h, int bits_per_pixel)
+  {
+  KLOG_IN
+  BitmapFB *self = malloc (sizeof (BitmapFB));
+  self->w = w;
+  self->h = h;
+  self->bytes_pp = bits_per_pixel / 8;
+  self->stride = (w * self->bytes_pp + ALIGN - 1) / ALIGN * ALIGN;
+  size_t size = (size_t)self->stride * h;
+  if (posix_memalign ((void **)&self->data, ALIGN, size ? size : ALIGN))
+    {
+    free (self);
+    self = NULL;
+    }
+  else
+    memset (self->data, 0, size);
+  KLOG_OUT
+  return self;
+  }
+
+/*==========================================================================
+  bitmapfb_create_for_fb
+*==========================================================================*/
+BitmapFB *bitmapfb_create_for_fb (const FrameBuffer *fb)
+  {
+  return bitmapfb_create (framebuffer_get_width (fb),
+    framebuffer_get_height (fb), framebuffer_get_bits_per_pixel (fb));
+  }
+
+/*==========================================================================
+  bitmapfb_destroy
+*==========================================================================*/
+void bitmapfb_destroy (BitmapFB *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    free (self->data);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmapfb_get_width
+*==========================================================================*/
+int bitmapfb_get_width (const BitmapFB *self)
+  {
+  return self->w;
+  }
+
+/*==========================================================================
+  bitmapfb_get_height
+*==========================================================================*/
+int bitmapfb_get_height (const BitmapFB *self)
+  {
+  return self->h;
+  }
+
+/*==========================================================================
+  bitmapfb_get_bits_per_pixel
+*==========================================================================*/
+int bitmapfb_get_bits_per_pixel (const BitmapFB *self)
+  {
+  return self->bytes_pp * 8;
+  }
+
+/*==========================================================================
+  bitmapfb_get_stride
+*==========================================================================*/
+int bitmapfb_get_stride (const BitmapFB *self)
+  {
+  return self->stride;
+  }
+
+/*==========================================================================
+  bitmapfb_get_data
+*==========================================================================*/
+BYTE *bitmapfb_get_data (BitmapFB *self)
+  {
+  return self->data;
+  }
+
+/*==========================================================================
+  bitmapfb_copy_from
+*==========================================================================*/
+void bitmapfb_copy_from (BitmapFB *self, const BitmapFB *other)
+  {
+  KLOG_IN
+  memcpy (self->data, other->data, (size_t)self->stride * self->h);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmapfb_clip
+  Clip the rectangle x,y (w x h) to a bitmap of max_w x max_h, returning
+  FALSE if nothing is left
+*==========================================================================*/
+static BOOL bitmapfb_clip (int max_w, int max_h, int *x, int *y,
+      int *w, int *h)
+  {
+  int x2 = *x + *w, y2 = *y + *h;
+  if (*x < 0) *x = 0;
+  if (*y < 0) *y = 0;
+  if (x2 > max_w) x2 = max_w;
+  if (y2 > max_h) y2 = max_h;
+  *w = x2 - *x;
+  *h = y2 - *y;
+  return *w > 0 && *h > 0;
+  }
+
+/*==========================================================================
+  bitmapfb_fill_rect
+  x2,y2 point is _excluded_
+*==========================================================================*/
+void bitmapfb_fill_rect (BitmapFB *self, int x1, int y1,
+      int x2, int y2, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  if (x1 > x2) { int t = x1; x1 = x2; x2 = t; }
+  if (y1 > y2) { int t = y1; y1 = y2; y2 = t; }
+  int w = x2 - x1, h = y2 - y1;
+  if (bitmapfb_clip (self->w, self->h, &x1, &y1, &w, &h))
+    {
+    // Build the first row from one pixel, by repeatedly doubling what
+    //   has been done so far, and copy it to the others
+    BYTE bgr[3] = {b, g, r};
+    BYTE *first = self->data + (size_t)y1 * self->stride
+      + (size_t)x1 * self->bytes_pp;
+    size_t len = (size_t)w * self->bytes_pp;
+    fb_format_from_bgr (bgr, first, self->bytes_pp, 1);
+    if (self->bytes_pp == 4) first[3] = 0;
+    for (size_t done = self->bytes_pp; done < len; done *= 2)
+      memcpy (first + done, first, done < len - done ? done : len - done);
+    for (int y = 1; y < h; y++)
+      memcpy (first + (size_t)y * self->stride, first, len);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmapfb_clear
+*==========================================================================*/
+void bitmapfb_clear (BitmapFB *self, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  bitmapfb_fill_rect (self, 0, 0, self->w, self->h, r, g, b);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmapfb_from_bitmaprgb
+*==========================================================================*/
+void bitmapfb_from_bitmaprgb (BitmapFB *self, const BitmapRGB *src,
+      int x, int y, int w, int h, BitmapRGBDither dither)
+  {
+  KLOG_IN
+  bitmapfb_from_bitmaprgb_tiled (self, src, x, y, w, h, dither, NULL);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmapfb_from_bitmaprgb_tiled
+*==========================================================================*/
+void bitmapfb_from_bitmaprgb_tiled (BitmapFB *self, const BitmapRGB *src,
+      int x, int y, int w, int h, BitmapRGBDither dither, KThreadPool *pool)
+  {
+  KLOG_IN
+  int max_w = self->w < src->w ? self->w : src->w;
+  int max_h = self->h < src->h ? self->h : src->h;
+  if (bitmapfb_clip (max_w, max_h, &x, &y, &w, &h))
+    {
+    bitmaprgb_write_pixels (src, x, y, w, h, self->data
+      + (size_t)y * self->stride + (size_t)x * self->bytes_pp,
+      self->stride, self->bytes_pp, x, y, dither, pool);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmapfb_to_fb_rect
+*==========================================================================*/
+void bitmapfb_to_fb_rect (const BitmapFB *self, FrameBuffer *fb,
+      int x, int y, int w, int h)
+  {
+  KLOG_IN
+  if (framebuffer_get_bits_per_pixel (fb) != self->bytes_pp * 8)
+    {
+    klog_warn (KLOG_CLASS, "Bitmap is %d bpp, but framebuffer is %d bpp",
+      self->bytes_pp * 8, framebuffer_get_bits_per_pixel (fb));
+    }
+  else
+    {
+    int fb_w = framebuffer_get_width (fb);
+    int fb_h = framebuffer_get_height (fb);
+    int max_w = self->w < fb_w ? self->w : fb_w;
+    int max_h = self->h < fb_h ? self->h : fb_h;
+    if (bitmapfb_clip (max_w, max_h, &x, &y, &w, &h))
+      {
+      size_t fb_stride = framebuffer_get_stride (fb);
+      size_t offset = (size_t)x * self->bytes_pp;
+      size_t len = (size_t)w * self->bytes_pp;
+      const BYTE *in = self->data + (size_t)y * self->stride + offset;
+      BYTE *out = framebuffer_get_data (fb) + y * fb_stride + offset;
+      if (fb_stride == (size_t)self->stride && len == fb_stride)
+        memcpy (out, in, len * h);
+      else
+        for (int row = 0; row < h; row++, in += self->stride,
+             out += fb_stride)
+          memcpy (out, in, len);
+      }
+    }
+  KLOG_OUT
+  }
+
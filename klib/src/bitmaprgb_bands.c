@@ -0,0 +1,78 @@
+/*============================================================================
+
+  bitmaprgb_bands.c
+
+  Sharing the work of an operation on a BitmapRGB between the threads
+  of a KThreadPool.
+
+  The work is split into bands of whole rows, each about BAND_BYTES
+  long, rather than into square tiles: the pixels of a row are
+  consecutive in memory, so a band is one run of memory, and no two
+  threads ever write to the same cache line except where two bands
+  meet. The bands are small enough that a band of the source and a
+  band of the destination fit in a core's L2 cache together, and there
+  are enough of them in a full-screen bitmap -- several dozen -- for
+  the threads to even out the work between them. Anything smaller
+  than a band is just done by the calling thread.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/kthreadpool.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_bands"
+
+// The size of a band, which is the smallest amount of work that is
+//   worth handing to another thread
+#define BAND_BYTES (128 * 1024)
+
+typedef struct _Bands
+  {
+  BitmapRGBBandFn band;
+  void *arg;
+  int h;
+  int rows; // In each band, except perhaps the last
+  } Bands;
+
+/*==========================================================================
+  bands_task
+*==========================================================================*/
+static void bands_task (void *arg, int index)
+  {
+  const Bands *bands = arg;
+  int y1 = index * bands->rows;
+  int y2 = y1 + bands->rows < bands->h ? y1 + bands->rows : bands->h;
+  bands->band (bands->arg, y1, y2);
+  }
+
+/*==========================================================================
+  bitmaprgb_bands
+*==========================================================================*/
+void bitmaprgb_bands (KThreadPool *pool, int h, size_t row_bytes,
+       BitmapRGBBandFn band, void *arg)
+  {
+  if (h <= 0) return;
+  size_t rows = row_bytes ? BAND_BYTES / row_bytes : (size_t)h;
+  if (rows < 1) rows = 1;
+  if (rows >= (size_t)h || kthreadpool_get_threads (pool) == 1)
+    {
+    band (arg, 0, h);
+    return;
+    }
+  Bands bands;
+  bands.band = band;
+  bands.arg = arg;
+  bands.h = h;
+  bands.rows = (int)rows;
+  kthreadpool_run (pool, (h + bands.rows - 1) / bands.rows, bands_task,
+    &bands);
+  }
+
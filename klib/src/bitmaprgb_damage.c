@@ -0,0 +1,217 @@
+/*============================================================================
+
+  bitmaprgb_damage.c
+
+  Tracking which parts of a BitmapRGB have changed, so that only those
+  need be copied to the screen.
+
+  The changes are kept as a list of at most BITMAPRGB_MAX_DAMAGE
+  rectangles. A new rectangle is merged with one already in the list
+  if at least three-quarters of the rectangle that covers both would
+  have changed anyway -- which takes care of a rectangle that is inside
+  another, and of runs of adjacent ones, like the characters of a line
+  of text. When the list is full, the new rectangle goes into whichever
+  one grows least by taking it. A merged rectangle may now be worth
+  merging with another, so each merge is followed by another pass.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_damage"
+
+// A rectangle from x1,y1 up to, but not including, x2,y2
+typedef struct _DamageRect
+  {
+  int x1, y1, x2, y2;
+  } DamageRect;
+
+struct _BitmapRGBDamage
+  {
+  int n;
+  DamageRect rects[BITMAPRGB_MAX_DAMAGE];
+  };
+
+/*==========================================================================
+  damage_area
+*==========================================================================*/
+static inline int64_t damage_area (const DamageRect *r)
+  {
+  return (int64_t)(r->x2 - r->x1) * (r->y2 - r->y1);
+  }
+
+/*==========================================================================
+  damage_union
+*==========================================================================*/
+static inline DamageRect damage_union (const DamageRect *a,
+      const DamageRect *b)
+  {
+  DamageRect u;
+  u.x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+  u.y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+  u.x2 = a->x2 > b->x2 ? a->x2 : b->x2;
+  u.y2 = a->y2 > b->y2 ? a->y2 : b->y2;
+  return u;
+  }
+
+/*==========================================================================
+  damage_waste
+  The number of pixels in the rectangle that covers both a and b that
+  are in neither
+*==========================================================================*/
+static int64_t damage_waste (const DamageRect *a, const DamageRect *b)
+  {
+  DamageRect u = damage_union (a, b);
+  DamageRect i;
+  i.x1 = a->x1 > b->x1 ? a->x1 : b->x1;
+  i.y1 = a->y1 > b->y1 ? a->y1 : b->y1;
+  i.x2 = a->x2 < b->x2 ? a->x2 : b->x2;
+  i.y2 = a->y2 < b->y2 ? a->y2 : b->y2;
+  int64_t overlap = i.x1 < i.x2 && i.y1 < i.y2 ? damage_area (&i) : 0;
+  return damage_area (&u) - damage_area (a) - damage_area (b) + overlap;
+  }
+
+/*==========================================================================
+  bitmaprgb_damage_add
+*==========================================================================*/
+void bitmaprgb_damage_add (BitmapRGB *self, int x1, int y1, int x2, int y2)
+  {
+  struct _BitmapRGBDamage *d = self->damage;
+  DamageRect r;
+  r.x1 = x1 < 0 ? 0 : x1;
+  r.y1 = y1 < 0 ? 0 : y1;
+  r.x2 = x2 > self->w ? self->w : x2;
+  r.y2 = y2 > self->h ? self->h : y2;
+  if (r.x1 >= r.x2 || r.y1 >= r.y2) return;
+
+  for (;;)
+    {
+    int merge = -1, cheapest = -1;
+    int64_t least = INT64_MAX;
+    for (int i = 0; i < d->n; i++)
+      {
+      DamageRect u = damage_union (&d->rects[i], &r);
+      int64_t waste = damage_waste (&d->rects[i], &r);
+      if (waste * 4 <= damage_area (&u))
+        {
+        merge = i;
+        break;
+        }
+      if (waste < least)
+        {
+        least = waste;
+        cheapest = i;
+        }
+      }
+    if (merge < 0)
+      {
+      if (d->n < BITMAPRGB_MAX_DAMAGE)
+        {
+        d->rects[d->n++] = r;
+        return;
+        }
+      merge = cheapest;
+      }
+    r = damage_union (&d->rects[merge], &r);
+    d->rects[merge] = d->rects[--d->n];
+    }
+  }
+
+/*==========================================================================
+  bitmaprgb_track_damage
+*==========================================================================*/
+void bitmaprgb_track_damage (BitmapRGB *self, BOOL track)
+  {
+  KLOG_IN
+  if (track)
+    {
+    if (!self->damage) self->damage = malloc (sizeof (*self->damage));
+    self->damage->n = 0;
+    }
+  else
+    {
+    free (self->damage);
+    self->damage = NULL;
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_add_damage
+*==========================================================================*/
+void bitmaprgb_add_damage (BitmapRGB *self, int x, int y, int w, int h)
+  {
+  if (w > 0 && h > 0) bitmaprgb_damage (self, x, y, x + w, y + h);
+  }
+
+/*==========================================================================
+  bitmaprgb_get_damage
+*==========================================================================*/
+int bitmaprgb_get_damage (const BitmapRGB *self, BitmapRGBRect *rects,
+      int max)
+  {
+  int n = self->damage ? self->damage->n : 0;
+  for (int i = 0; i < n && i < max; i++)
+    {
+    const DamageRect *r = &self->damage->rects[i];
+    rects[i].x = r->x1;
+    rects[i].y = r->y1;
+    rects[i].w = r->x2 - r->x1;
+    rects[i].h = r->y2 - r->y1;
+    }
+  return n;
+  }
+
+/*==========================================================================
+  bitmaprgb_clear_damage
+*==========================================================================*/
+void bitmaprgb_clear_damage (BitmapRGB *self)
+  {
+  if (self->damage) self->damage->n = 0;
+  }
+
+/*==========================================================================
+  bitmaprgb_present
+*==========================================================================*/
+void bitmaprgb_present (BitmapRGB *self, FrameBuffer *fb,
+      BitmapRGBDither dither)
+  {
+  KLOG_IN
+  bitmaprgb_present_transformed (self, fb, BITMAPRGB_TRANSFORM_NONE,
+    dither);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_present_transformed
+*==========================================================================*/
+void bitmaprgb_present_transformed (BitmapRGB *self, FrameBuffer *fb,
+      BitmapRGBTransform transform, BitmapRGBDither dither)
+  {
+  KLOG_IN
+  BitmapRGBRect rects[BITMAPRGB_MAX_DAMAGE];
+  int n = bitmaprgb_get_damage (self, rects, BITMAPRGB_MAX_DAMAGE);
+  for (int i = 0; i < n; i++)
+    {
+    const BitmapRGBRect *r = &rects[i];
+    if (transform == BITMAPRGB_TRANSFORM_NONE)
+      bitmaprgb_to_fb_rect_dithered (self, fb, r->x, r->y, r->w, r->h,
+        dither);
+    else
+      bitmaprgb_to_fb_rect_transformed (self, fb, r->x, r->y, r->w, r->h,
+        transform, dither);
+    }
+  bitmaprgb_clear_damage (self);
+  KLOG_OUT
+  }
+
@@ -0,0 +1,245 @@
+/*============================================================================
+
+  bitmaprgb_dither.c
+
+  Writing a BitmapRGB to the framebuffer, or to a BitmapFB, in
+  whatever format the framebuffer uses, and reducing the colours if it
+  has fewer than 24 bits per pixel -- in practice, RGB565.
+
+  Ordered dithering adds a threshold from an 8x8 Bayer matrix to each
+  channel before the low bits are dropped, so that a shade that falls
+  between two levels is shown as a fine pattern of both. The threshold
+  depends only on where the pixel is, so eight pixels can be done at a
+  time, with the vector types in simd.h: the channels of eight pixels
+  are pulled apart with two shuffles, have the thresholds for the row
+  added, and are packed back into eight 16-bit pixels.
+
+  Error diffusion (Floyd-Steinberg) passes what was lost from each pixel
+  on to the ones to the right and below, which looks better in a still
+  image but is inherently one pixel at a time. The errors do not cross
+  the edge of the rectangle being written, so redrawing part of the
+  screen gives the same pixels as redrawing all of it only for ordered
+  dithering. For the same reason, it is the only conversion that is
+  not shared between the threads of a pool.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+#include "fb_format.h"
+#include "simd.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_dither"
+
+typedef uint8_t v16b __attribute__ ((vector_size (16)));
+
+static const BYTE bayer[8][8] =
+  {
+  {  0, 32,  8, 40,  2, 34, 10, 42 },
+  { 48, 16, 56, 24, 50, 18, 58, 26 },
+  { 12, 44,  4, 36, 14, 46,  6, 38 },
+  { 60, 28, 52, 20, 62, 30, 54, 22 },
+  {  3, 35, 11, 43,  1, 33,  9, 41 },
+  { 51, 19, 59, 27, 49, 17, 57, 25 },
+  { 15, 47,  7, 39, 13, 45,  5, 37 },
+  { 63, 31, 55, 23, 61, 29, 53, 21 }
+  };
+
+/*==========================================================================
+  dither_pack
+  Make an RGB565 pixel from channels that have already been reduced,
+  except that they may be one more than the maximum
+*==========================================================================*/
+static inline uint16_t dither_pack (int r5, int g6, int b5)
+  {
+  r5 -= r5 >> 5; g6 -= g6 >> 6; b5 -= b5 >> 5;
+  return (r5 << 11) | (g6 << 5) | b5;
+  }
+
+/*==========================================================================
+  dither_ordered_row
+  Write n pixels of in to out, as RGB565, with the row y of the Bayer
+  matrix, starting at column x
+*==========================================================================*/
+static void dither_ordered_row (const BYTE *in, BYTE *out, int n,
+      int x, int y)
+  {
+  // Five-bit channels lose three bits, so the threshold (0-63) is cut
+  //   to 0-7; green loses two, so to 0-3
+  const BYTE *t = bayer[y & 7];
+  v8s t5, t6;
+  for (int i = 0; i < 8; i++)
+    {
+    t5[i] = t[(x + i) & 7] >> 3;
+    t6[i] = t[(x + i) & 7] >> 4;
+    }
+
+  // Eight pixels are 24 bytes, read as bytes 0-15 and 8-23. In a
+  //   shuffle of the two, 16 + k is byte k of the second
+  const v16b bg_mask = {0, 3, 6, 9, 12, 15, 26, 29,
+                        1, 4, 7, 10, 13, 24, 27, 30};
+  const v16b r_mask = {2, 5, 8, 11, 14, 25, 28, 31};
+  int i = 0;
+  for (; i + 8 <= n; i += 8, in += 24, out += 16)
+    {
+    v16b lo, hi;
+    memcpy (&lo, in, 16);
+    memcpy (&hi, in + 8, 16);
+    v16b bg = __builtin_shuffle (lo, hi, bg_mask);
+    v16b rx = __builtin_shuffle (lo, hi, r_mask);
+    v8b b8, g8, r8;
+    memcpy (&b8, &bg, 8);
+    memcpy (&g8, (BYTE *)&bg + 8, 8);
+    memcpy (&r8, &rx, 8);
+    v8s b = (__builtin_convertvector (b8, v8s) + t5) >> 3;
+    v8s g = (__builtin_convertvector (g8, v8s) + t6) >> 2;
+    v8s r = (__builtin_convertvector (r8, v8s) + t5) >> 3;
+    // The sums can reach 32 or 64, one too many; take that one off
+    b -= b >> 5; g -= g >> 6; r -= r >> 5;
+    v8s p = (r << 11) | (g << 5) | b;
+    memcpy (out, &p, 16);
+    }
+
+  for (; i < n; i++, in += 3, out += 2)
+    {
+    int th = t[(x + i) & 7];
+    uint16_t p = dither_pack ((in[2] + (th >> 3)) >> 3,
+      (in[1] + (th >> 4)) >> 2, (in[0] + (th >> 3)) >> 3);
+    out[0] = p;
+    out[1] = p >> 8;
+    }
+  }
+
+/*==========================================================================
+  dither_level
+  The nearest level to v of a channel with max+1 levels, as the index
+  of the level, and as the byte that RGB565 is widened back to
+*==========================================================================*/
+static inline int dither_level (int v, int max, int shift, int *level)
+  {
+  if (v < 0) v = 0;
+  if (v > 255) v = 255;
+  *level = (v * max + 127) / 255;
+  return (*level << shift) | (*level >> (8 - 2 * shift));
+  }
+
+/*==========================================================================
+  dither_diffuse
+  Floyd-Steinberg, onto h rows of w pixels of RGB565. The errors are
+  kept times 16, with a pixel of margin either side of each row
+*==========================================================================*/
+static void dither_diffuse (const BitmapRGB *self, int sx, int sy,
+      int w, int h, BYTE *out, int stride)
+  {
+  int *cur = calloc ((size_t)(w + 2) * 3, sizeof (int));
+  int *next = calloc ((size_t)(w + 2) * 3, sizeof (int));
+  static const int max[3] = {31, 63, 31};
+  static const int shift[3] = {3, 2, 3};
+  for (int y = 0; y < h; y++)
+    {
+    const BYTE *in = self->data + ((size_t)(sy + y) * self->w + sx) * BPP;
+    BYTE *o = out + (size_t)y * stride;
+    memset (next, 0, (size_t)(w + 2) * 3 * sizeof (int));
+    for (int x = 0; x < w; x++, in += BPP, o += 2)
+      {
+      int level[3];
+      for (int c = 0; c < 3; c++)
+        {
+        int *e = cur + (x + 1) * 3 + c;
+        int v = in[c] + ((*e + 8) >> 4);
+        int err = v - dither_level (v, max[c], shift[c], &level[c]);
+        e[3] += err * 7;
+        int *n = next + (x + 1) * 3 + c;
+        n[-3] += err * 3;
+        n[0] += err * 5;
+        n[3] += err;
+        }
+      uint16_t p = (level[2] << 11) | (level[1] << 5) | level[0];
+      o[0] = p;
+      o[1] = p >> 8;
+      }
+    int *t = cur; cur = next; next = t;
+    }
+  free (cur);
+  free (next);
+  }
+
+// The arguments of bitmaprgb_write_pixels(), for write_band()
+typedef struct _WriteJob
+  {
+  const BitmapRGB *self;
+  int sx, sy, w;
+  BYTE *out;
+  int stride, bytes_pp, dx, dy;
+  BitmapRGBDither dither;
+  } WriteJob;
+
+/*==========================================================================
+  write_band
+  Write the rows y1 up to y2 of the rectangle of a WriteJob
+*==========================================================================*/
+static void write_band (void *arg, int y1, int y2)
+  {
+  const WriteJob *job = arg;
+  const BYTE *in = job->self->data
+    + ((size_t)(job->sy + y1) * job->self->w + job->sx) * BPP;
+  size_t in_stride = (size_t)job->self->w * BPP;
+  BYTE *out = job->out + (size_t)y1 * job->stride;
+
+  if (job->bytes_pp == 2 && job->dither == BITMAPRGB_DITHER_ORDERED)
+    {
+    for (int y = y1; y < y2; y++, in += in_stride, out += job->stride)
+      dither_ordered_row (in, out, job->w, job->dx, job->dy + y);
+    }
+  else
+    {
+    for (int y = y1; y < y2; y++, in += in_stride, out += job->stride)
+      fb_format_from_bgr (in, out, job->bytes_pp, job->w);
+    }
+  }
+
+/*==========================================================================
+  bitmaprgb_write_pixels
+  Error diffusion carries from each row to the next, so can only be
+  done by one thread
+*==========================================================================*/
+void bitmaprgb_write_pixels (const BitmapRGB *self, int sx, int sy,
+       int w, int h, BYTE *out, int stride, int bytes_pp, int dx, int dy,
+       BitmapRGBDither dither, KThreadPool *pool)
+  {
+  if (bytes_pp == 2 && dither == BITMAPRGB_DITHER_DIFFUSION)
+    dither_diffuse (self, sx, sy, w, h, out, stride);
+  else
+    {
+    WriteJob job = {self, sx, sy, w, out, stride, bytes_pp, dx, dy, dither};
+    bitmaprgb_bands (pool, h, (size_t)w * (BPP + bytes_pp), write_band,
+      &job);
+    }
+  }
+
+/*==========================================================================
+  bitmaprgb_write_fb
+*==========================================================================*/
+void bitmaprgb_write_fb (const BitmapRGB *self, int sx, int sy, int w, int h,
+       FrameBuffer *fb, int dx, int dy, BitmapRGBDither dither,
+       KThreadPool *pool)
+  {
+  KLOG_IN
+  int bytes_pp = framebuffer_get_bits_per_pixel (fb) / 8;
+  int stride = framebuffer_get_stride (fb);
+  BYTE *out = framebuffer_get_data (fb) + (size_t)dy * stride
+    + (size_t)dx * bytes_pp;
+  bitmaprgb_write_pixels (self, sx, sy, w, h, out, stride, bytes_pp,
+    dx, dy, dither, pool);
+  KLOG_OUT
+  }
+
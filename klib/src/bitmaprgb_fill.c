@@ -0,0 +1,278 @@
+/*============================================================================
+
+  bitmaprgb_fill.c
+
+  Filling rectangles of a BitmapRGB. The rectangle is clipped once, and
+  the first row is built directly in the bitmap; every other row is a
+  copy of it (or, for a checkerboard, of one of two rows). A solid
+  row, and a solid rectangle that spans the whole width of the bitmap,
+  is built from a single pixel by repeatedly copying what has been
+  done so far, so even a full-screen fill is a couple of dozen large
+  memcpy() calls.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_fill"
+
+// A rectangle to be filled: the corners as given, put in order, and the
+//   part of it that is within the bitmap
+typedef struct _FillRect
+  {
+  int x1, y1, x2, y2;
+  int cx1, cy1, cx2, cy2;
+  } FillRect;
+
+/*==========================================================================
+  fill_clip
+  Returns FALSE if no part of the rectangle is within the bitmap
+*==========================================================================*/
+static BOOL fill_clip (const BitmapRGB *self, FillRect *r,
+      int x1, int y1, int x2, int y2)
+  {
+  if (x1 > x2) { int t = x1; x1 = x2; x2 = t; }
+  if (y1 > y2) { int t = y1; y1 = y2; y2 = t; }
+  r->x1 = x1; r->y1 = y1; r->x2 = x2; r->y2 = y2;
+  r->cx1 = x1 < 0 ? 0 : x1;
+  r->cy1 = y1 < 0 ? 0 : y1;
+  r->cx2 = x2 > self->w ? self->w : x2;
+  r->cy2 = y2 > self->h ? self->h : y2;
+  return r->cx1 < r->cx2 && r->cy1 < r->cy2;
+  }
+
+/*==========================================================================
+  fill_replicate
+  The first done bytes at p are repeated until total bytes are filled
+*==========================================================================*/
+static void fill_replicate (BYTE *p, size_t done, size_t total)
+  {
+  while (done < total)
+    {
+    size_t n = done < total - done ? done : total - done;
+    memcpy (p + done, p, n);
+    done += n;
+    }
+  }
+
+/*==========================================================================
+  fill_row_ptr
+*==========================================================================*/
+static inline BYTE *fill_row_ptr (BitmapRGB *self, int x, int y)
+  {
+  return self->data + ((size_t)y * self->w + x) * BPP;
+  }
+
+/*==========================================================================
+  fill_copy_rows
+  Copy the clipped part of row y1 of the rectangle to all its other rows
+*==========================================================================*/
+static void fill_copy_rows (BitmapRGB *self, const FillRect *r)
+  {
+  const BYTE *first = fill_row_ptr (self, r->cx1, r->cy1);
+  size_t len = (size_t)(r->cx2 - r->cx1) * BPP;
+  for (int y = r->cy1 + 1; y < r->cy2; y++)
+    memcpy (fill_row_ptr (self, r->cx1, y), first, len);
+  }
+
+/*==========================================================================
+  bitmaprgb_fill_rect
+*==========================================================================*/
+void bitmaprgb_fill_rect (BitmapRGB *self, int x1, int y1,
+      int x2, int y2, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  FillRect fr;
+  if (fill_clip (self, &fr, x1, y1, x2, y2))
+    {
+    bitmaprgb_damage (self, fr.cx1, fr.cy1, fr.cx2, fr.cy2);
+    BYTE *p = fill_row_ptr (self, fr.cx1, fr.cy1);
+    size_t len = (size_t)(fr.cx2 - fr.cx1) * BPP;
+    if (r == g && g == b)
+      {
+      // Grey, so every byte is the same
+      if (len == (size_t)self->w * BPP)
+        memset (p, r, len * (fr.cy2 - fr.cy1));
+      else
+        for (int y = fr.cy1; y < fr.cy2; y++, p += (size_t)self->w * BPP)
+          memset (p, r, len);
+      }
+    else
+      {
+      p[0] = b; p[1] = g; p[2] = r;
+      if (len == (size_t)self->w * BPP)
+        {
+        // The rows are contiguous, so fill them as one
+        fill_replicate (p, BPP, len * (fr.cy2 - fr.cy1));
+        }
+      else
+        {
+        fill_replicate (p, BPP, len);
+        fill_copy_rows (self, &fr);
+        }
+      }
+    }
+  KLOG_OUT
+  }
+
+// A rectangle that is being filled by bitmaprgb_fill_rect_tiled()
+typedef struct _FillJob
+  {
+  BitmapRGB *self;
+  FillRect r;
+  BOOL grey; // If so, every byte is value; if not, copy the first row
+  BYTE value;
+  } FillJob;
+
+/*==========================================================================
+  fill_band
+  Fill the rows y1 up to y2, counting from the top of the clipped
+  rectangle of a FillJob
+*==========================================================================*/
+static void fill_band (void *arg, int y1, int y2)
+  {
+  const FillJob *job = arg;
+  const FillRect *r = &job->r;
+  const BYTE *first = fill_row_ptr (job->self, r->cx1, r->cy1);
+  size_t len = (size_t)(r->cx2 - r->cx1) * BPP;
+  for (int y = y1; y < y2; y++)
+    {
+    BYTE *p = fill_row_ptr (job->self, r->cx1, r->cy1 + y);
+    if (job->grey)
+      memset (p, job->value, len);
+    else if (p != first)
+      memcpy (p, first, len);
+    }
+  }
+
+/*==========================================================================
+  bitmaprgb_fill_rect_tiled
+  The first row is built as bitmaprgb_fill_rect() does, and the others
+  copied from it in bands. Just copying a few megabytes is limited by
+  the memory, not the CPU, so this is the least of the tiled
+  operations; but one core on its own usually can't keep the memory
+  fully busy
+*==========================================================================*/
+void bitmaprgb_fill_rect_tiled (BitmapRGB *self, int x1, int y1,
+      int x2, int y2, BYTE r, BYTE g, BYTE b, KThreadPool *pool)
+  {
+  KLOG_IN
+  FillJob job;
+  if (kthreadpool_get_threads (pool) == 1)
+    bitmaprgb_fill_rect (self, x1, y1, x2, y2, r, g, b);
+  else if (fill_clip (self, &job.r, x1, y1, x2, y2))
+    {
+    bitmaprgb_damage (self, job.r.cx1, job.r.cy1, job.r.cx2, job.r.cy2);
+    job.self = self;
+    job.grey = r == g && g == b;
+    job.value = r;
+    if (!job.grey)
+      {
+      BYTE *p = fill_row_ptr (self, job.r.cx1, job.r.cy1);
+      p[0] = b; p[1] = g; p[2] = r;
+      fill_replicate (p, BPP, (size_t)(job.r.cx2 - job.r.cx1) * BPP);
+      }
+    bitmaprgb_bands (pool, job.r.cy2 - job.r.cy1,
+      (size_t)(job.r.cx2 - job.r.cx1) * BPP, fill_band, &job);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_clear
+*==========================================================================*/
+void bitmaprgb_clear (BitmapRGB *self, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  bitmaprgb_fill_rect (self, 0, 0, self->w, self->h, r, g, b);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_fill_gradient
+*==========================================================================*/
+void bitmaprgb_fill_gradient (BitmapRGB *self, int x1, int y1,
+      int x2, int y2, BYTE r1, BYTE g1, BYTE b1,
+      BYTE r2, BYTE g2, BYTE b2)
+  {
+  KLOG_IN
+  FillRect fr;
+  if (fill_clip (self, &fr, x1, y1, x2, y2))
+    {
+    bitmaprgb_damage (self, fr.cx1, fr.cy1, fr.cx2, fr.cy2);
+    // Interpolate in 16.16 fixed point, so the last column of the
+    //   rectangle is exactly r2,g2,b2
+    int span = fr.x2 - fr.x1 - 1;
+    int32_t db = 0, dg = 0, dr = 0;
+    if (span > 0)
+      {
+      db = ((b2 - b1) * 65536) / span;
+      dg = ((g2 - g1) * 65536) / span;
+      dr = ((r2 - r1) * 65536) / span;
+      }
+    int offset = fr.cx1 - fr.x1;
+    int32_t b = b1 * 65536 + db * offset + 32768;
+    int32_t g = g1 * 65536 + dg * offset + 32768;
+    int32_t r = r1 * 65536 + dr * offset + 32768;
+    BYTE *p = fill_row_ptr (self, fr.cx1, fr.cy1);
+    for (int x = fr.cx1; x < fr.cx2; x++, p += BPP)
+      {
+      p[0] = b >> 16; p[1] = g >> 16; p[2] = r >> 16;
+      b += db; g += dg; r += dr;
+      }
+    fill_copy_rows (self, &fr);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_fill_checker
+*==========================================================================*/
+void bitmaprgb_fill_checker (BitmapRGB *self, int x1, int y1,
+      int x2, int y2, int size, BYTE r1, BYTE g1, BYTE b1,
+      BYTE r2, BYTE g2, BYTE b2)
+  {
+  KLOG_IN
+  FillRect fr;
+  if (size < 1) size = 1;
+  if (fill_clip (self, &fr, x1, y1, x2, y2))
+    {
+    bitmaprgb_damage (self, fr.cx1, fr.cy1, fr.cx2, fr.cy2);
+    // Build the two kinds of row -- one starting with each colour --
+    //   in the first row of the rectangle, and (if it has one) the
+    //   first row of the next band of squares
+    const BYTE *rows[2] = {NULL, NULL};
+    size_t len = (size_t)(fr.cx2 - fr.cx1) * BPP;
+    for (int y = fr.cy1; y < fr.cy2 && y < fr.cy1 + 2 * size; y++)
+      {
+      int phase = ((y - fr.y1) / size) & 1;
+      if (rows[phase]) continue;
+      BYTE *p = fill_row_ptr (self, fr.cx1, y);
+      for (int x = fr.cx1; x < fr.cx2; x++, p += BPP)
+        {
+        BOOL first = ((((x - fr.x1) / size) & 1) == phase);
+        p[0] = first ? b1 : b2;
+        p[1] = first ? g1 : g2;
+        p[2] = first ? r1 : r2;
+        }
+      rows[phase] = fill_row_ptr (self, fr.cx1, y);
+      }
+    for (int y = fr.cy1; y < fr.cy2; y++)
+      {
+      const BYTE *src = rows[((y - fr.y1) / size) & 1];
+      BYTE *p = fill_row_ptr (self, fr.cx1, y);
+      if (p != src) memcpy (p, src, len);
+      }
+    }
+  KLOG_OUT
+  }
+
@@ -0,0 +1,828 @@
+/*============================================================================
+
+  bitmaprgb_jpeg.c
+
+  A decoder for baseline (sequential, 8-bit, Huffman-coded) JPEG images,
+  with one (greyscale) or three (YCbCr or RGB) components, any sampling
+  factors, and restart markers. Progressive and arithmetic-coded
+  images are not supported.
+
+  The image can be decoded at 1/2, 1/4, or 1/8 scale, by working out
+  only the lowest 4x4, 2x2, or 1x1 frequencies of each 8x8 block; at
+  1/8 scale, this is just the DC coefficient. The other coefficients
+  still have to be Huffman-decoded, but are otherwise ignored, and
+  memory is only allocated for the reduced image. So when a large
+  photo is going to be shown on a small screen, most of the work of
+  decoding it, and most of the memory, is saved.
+
+  The inverse DCT is done as two passes of matrix multiplication,
+  using SIMD vectors (see simd.h) for whole rows of a block at a
+  time, and skipping the coefficients that are zero, which is most of
+  them. The same code handles every scale, with a matrix for the
+  block size in use. Colour conversion uses SIMD vectors as well.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/bitmaprgb.h>
+#include "simd.h"
+#include "bitmaprgb_loaders.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_jpeg"
+
+// Huffman codes up to this length are decoded by a single table lookup
+#define HUFF_LOOKAHEAD 9
+#define MAX_COMPONENTS 3
+
+// Position of each coefficient in an 8x8 block, in the order they
+//   are stored in the file
+static const BYTE zigzag[64] =
+  {
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+  };
+
+// cos (k * pi / 16), for k = 0-8
+static const float cos16[9] =
+  {
+  1.0f, 0.98078528f, 0.92387953f, 0.83146961f, 0.70710678f,
+  0.55557023f, 0.38268343f, 0.19509032f, 0.0f
+  };
+
+typedef struct _JpegHuff
+  {
+  BOOL defined;
+  BYTE lookup_len[1 << HUFF_LOOKAHEAD]; // Zero if the code is longer
+  BYTE lookup_sym[1 << HUFF_LOOKAHEAD];
+  int mincode[17];
+  int maxcode[17]; // -1 if there are no codes of this length
+  int valptr[17];
+  BYTE huffval[256];
+  } JpegHuff;
+
+typedef struct _JpegComponent
+  {
+  int id;
+  int h; // Sampling factors
+  int v;
+  int tq; // Quantization table
+  int dc; // Huffman tables
+  int ac;
+  int pred; // Last DC value
+  int plane_w;
+  int plane_h;
+  BYTE *plane; // Decoded samples, at the reduced scale
+  } JpegComponent;
+
+typedef struct _JpegDecoder
+  {
+  const BYTE *data;
+  size_t size;
+  size_t pos;
+  uint32_t bits; // Bit buffer, most significant bit first
+  int nbits;
+  BOOL marker_hit; // End of the entropy-coded data
+  uint16_t qt[4][64]; // In zigzag order
+  JpegHuff dc[4];
+  JpegHuff ac[4];
+  int w;
+  int h;
+  int ncomp;
+  JpegComponent comp[MAX_COMPONENTS];
+  int hmax;
+  int vmax;
+  int mcus_x;
+  int mcus_y;
+  int restart_interval;
+  int adobe_transform; // From an Adobe APP14 marker, or -1 if none
+  int n; // Size of a decoded block: 8, 4, 2, or 1
+  v4f basis[8][2]; // basis[u] holds the n outputs for frequency u
+  BOOL decoded; // A scan has been decoded
+  const char *error;
+  } JpegDecoder;
+
+/*==========================================================================
+  jpeg_cos16
+  cos (k * pi / 16), for any k >= 0
+*==========================================================================*/
+static float jpeg_cos16 (int k)
+  {
+  k %= 32;
+  if (k > 16) k = 32 - k;
+  if (k > 8) return -cos16[16 - k];
+  return cos16[k];
+  }
+
+/*==========================================================================
+  jpeg_set_scale
+  Set the block size, and work out the IDCT matrix for it. Each output
+  depends only on the lowest n frequencies, with the same weights as
+  for an n-point DCT, so that the average level is unchanged.
+*==========================================================================*/
+static void jpeg_set_scale (JpegDecoder *self, int n)
+  {
+  self->n = n;
+  memset (self->basis, 0, sizeof (self->basis));
+  for (int u = 0; u < n; u++)
+    {
+    float cu = u == 0 ? cos16[4] : 1.0f;
+    for (int x = 0; x < n; x++)
+      self->basis[u][x / 4][x % 4] =
+        0.5f * cu * jpeg_cos16 ((2 * x + 1) * u * (8 / n));
+    }
+  }
+
+/*==========================================================================
+  jpeg_u16
+  Read a big-endian 16-bit value from the marker data, or -1 if there
+  isn't one.
+*==========================================================================*/
+static int jpeg_u16 (JpegDecoder *self)
+  {
+  if (self->pos + 2 > self->size) return -1;
+  int ret = (self->data[self->pos] << 8) | self->data[self->pos + 1];
+  self->pos += 2;
+  return ret;
+  }
+
+/*==========================================================================
+  jpeg_next_byte
+  Get the next byte of entropy-coded data, removing byte stuffing. At a
+  marker, returns zeroes without going any further.
+*==========================================================================*/
+static int jpeg_next_byte (JpegDecoder *self)
+  {
+  if (self->marker_hit || self->pos >= self->size)
+    {
+    self->marker_hit = TRUE;
+    return 0;
+    }
+  int b = self->data[self->pos];
+  if (b == 0xFF)
+    {
+    if (self->pos + 1 < self->size && self->data[self->pos + 1] == 0)
+      {
+      self->pos += 2;
+      return 0xFF;
+      }
+    self->marker_hit = TRUE;
+    return 0;
+    }
+  self->pos++;
+  return b;
+  }
+
+/*==========================================================================
+  jpeg_fill
+*==========================================================================*/
+static inline void jpeg_fill (JpegDecoder *self)
+  {
+  while (self->nbits <= 24)
+    {
+    self->bits |= (uint32_t)jpeg_next_byte (self) << (24 - self->nbits);
+    self->nbits += 8;
+    }
+  }
+
+/*==========================================================================
+  jpeg_get_bits
+  Read n bits, where n is 1-16
+*==========================================================================*/
+static inline int jpeg_get_bits (JpegDecoder *self, int n)
+  {
+  jpeg_fill (self);
+  int ret = self->bits >> (32 - n);
+  self->bits <<= n;
+  self->nbits -= n;
+  return ret;
+  }
+
+/*==========================================================================
+  jpeg_extend
+  Convert n bits read from the file into a signed value
+*==========================================================================*/
+static inline int jpeg_extend (int v, int n)
+  {
+  return v < (1 << (n - 1)) ? v - (1 << n) + 1 : v;
+  }
+
+/*==========================================================================
+  jpeg_huff_decode
+  Returns the next symbol, or -1 if the data is not valid
+*==========================================================================*/
+static inline int jpeg_huff_decode (JpegDecoder *self, const JpegHuff *huff)
+  {
+  jpeg_fill (self);
+  int look = self->bits >> (32 - HUFF_LOOKAHEAD);
+  int len = huff->lookup_len[look];
+  if (len)
+    {
+    self->bits <<= len;
+    self->nbits -= len;
+    return huff->lookup_sym[look];
+    }
+  for (len = HUFF_LOOKAHEAD + 1; len <= 16; len++)
+    {
+    int code = self->bits >> (32 - len);
+    if (code <= huff->maxcode[len])
+      {
+      self->bits <<= len;
+      self->nbits -= len;
+      return huff->huffval[huff->valptr[len] + code - huff->mincode[len]];
+      }
+    }
+  return -1;
+  }
+
+/*==========================================================================
+  jpeg_build_huff
+  Set up the decoding tables from the counts of codes of each length,
+  as described in Annex C of the JPEG standard.
+*==========================================================================*/
+static BOOL jpeg_build_huff (JpegHuff *huff, const BYTE *counts,
+      const BYTE *symbols, int nsymbols)
+  {
+  memset (huff, 0, sizeof (JpegHuff));
+  memcpy (huff->huffval, symbols, nsymbols);
+  int code = 0, k = 0;
+  for (int len = 1; len <= 16; len++)
+    {
+    huff->valptr[len] = k;
+    huff->mincode[len] = code;
+    for (int i = 0; i < counts[len - 1]; i++)
+      {
+      if (code >= (1 << len)) return FALSE;
+      if (len <= HUFF_LOOKAHEAD)
+        {
+        int shift = HUFF_LOOKAHEAD - len;
+        for (int j = 0; j < (1 << shift); j++)
+          {
+          huff->lookup_len[(code << shift) + j] = len;
+          huff->lookup_sym[(code << shift) + j] = symbols[k];
+          }
+        }
+      code++;
+      k++;
+      }
+    huff->maxcode[len] = counts[len - 1] ? code - 1 : -1;
+    code <<= 1;
+    }
+  huff->defined = TRUE;
+  return TRUE;
+  }
+
+/*==========================================================================
+  jpeg_parse_dht
+*==========================================================================*/
+static BOOL jpeg_parse_dht (JpegDecoder *self, size_t end)
+  {
+  while (self->pos < end)
+    {
+    if (self->pos + 17 > end) return FALSE;
+    int tc = self->data[self->pos] >> 4;
+    int th = self->data[self->pos] & 0x0F;
+    const BYTE *counts = self->data + self->pos + 1;
+    int nsymbols = 0;
+    for (int i = 0; i < 16; i++) nsymbols += counts[i];
+    self->pos += 17;
+    if (tc > 1 || th > 3 || nsymbols > 256 || self->pos + nsymbols > end)
+      return FALSE;
+    JpegHuff *huff = tc == 0 ? &self->dc[th] : &self->ac[th];
+    if (!jpeg_build_huff (huff, counts, self->data + self->pos, nsymbols))
+      return FALSE;
+    self->pos += nsymbols;
+    }
+  return TRUE;
+  }
+
+/*==========================================================================
+  jpeg_parse_dqt
+*==========================================================================*/
+static BOOL jpeg_parse_dqt (JpegDecoder *self, size_t end)
+  {
+  while (self->pos < end)
+    {
+    int pq = self->data[self->pos] >> 4;
+    int tq = self->data[self->pos] & 0x0F;
+    self->pos++;
+    if (pq > 1 || tq > 3 || self->pos + 64 * (pq + 1) > end) return FALSE;
+    for (int i = 0; i < 64; i++)
+      {
+      if (pq)
+        {
+        self->qt[tq][i] = (self->data[self->pos] << 8)
+          | self->data[self->pos + 1];
+        self->pos += 2;
+        }
+      else
+        self->qt[tq][i] = self->data[self->pos++];
+      }
+    }
+  return TRUE;
+  }
+
+/*==========================================================================
+  jpeg_parse_sof
+  Read the frame header, choose the scale, and allocate the planes
+*==========================================================================*/
+static BOOL jpeg_parse_sof (JpegDecoder *self, size_t end, int max_w,
+      int max_h)
+  {
+  if (self->ncomp)
+    {
+    self->error = "more than one frame header";
+    return FALSE;
+    }
+  if (self->pos + 6 > end || self->data[self->pos] != 8)
+    {
+    self->error = "unsupported sample precision";
+    return FALSE;
+    }
+  self->h = (self->data[self->pos + 1] << 8) | self->data[self->pos + 2];
+  self->w = (self->data[self->pos + 3] << 8) | self->data[self->pos + 4];
+  int ncomp = self->data[self->pos + 5];
+  self->pos += 6;
+  if (self->w == 0 || self->h == 0 || (int64_t)self->w * self->h > MAX_PIXELS)
+    {
+    self->error = "unsupported image size";
+    return FALSE;
+    }
+  if ((ncomp != 1 && ncomp != 3) || self->pos + ncomp * 3 > end)
+    {
+    self->error = "unsupported number of colour components";
+    return FALSE;
+    }
+
+  self->hmax = self->vmax = 1;
+  for (int i = 0; i < ncomp; i++)
+    {
+    JpegComponent *c = &self->comp[i];
+    c->id = self->data[self->pos];
+    c->h = self->data[self->pos + 1] >> 4;
+    c->v = self->data[self->pos + 1] & 0x0F;
+    c->tq = self->data[self->pos + 2] & 0x03;
+    self->pos += 3;
+    if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4)
+      {
+      self->error = "invalid sampling factors";
+      return FALSE;
+      }
+    // With only one component, an MCU is always a single block
+    if (ncomp == 1) c->h = c->v = 1;
+    if (c->h > self->hmax) self->hmax = c->h;
+    if (c->v > self->vmax) self->vmax = c->v;
+    }
+  self->ncomp = ncomp;
+
+  // Use the smallest scale that gives at least as many pixels as the
+  //   image will have when it's scaled to fit max_w x max_h
+  int n = 8;
+  if (max_w > 0 && max_h > 0)
+    {
+    int fit_w = max_w;
+    int fit_h = (int)((int64_t)self->h * max_w / self->w);
+    if (fit_h > max_h)
+      {
+      fit_h = max_h;
+      fit_w = (int)((int64_t)self->w * max_h / self->h);
+      }
+    for (n = 1; n < 8; n *= 2)
+      {
+      if ((self->w * n + 7) / 8 >= fit_w && (self->h * n + 7) / 8 >= fit_h)
+        break;
+      }
+    }
+  jpeg_set_scale (self, n);
+  klog_debug (KLOG_CLASS, "Decoding %dx%d JPEG at scale 1/%d",
+    self->w, self->h, 8 / n);
+
+  self->mcus_x = (self->w + 8 * self->hmax - 1) / (8 * self->hmax);
+  self->mcus_y = (self->h + 8 * self->vmax - 1) / (8 * self->vmax);
+  for (int i = 0; i < ncomp; i++)
+    {
+    JpegComponent *c = &self->comp[i];
+    c->plane_w = self->mcus_x * c->h * n;
+    c->plane_h = self->mcus_y * c->v * n;
+    // Colour conversion may read a few bytes beyond the last row
+    c->plane = calloc ((size_t)c->plane_w * c->plane_h + 4, 1);
+    if (!c->plane)
+      {
+      self->error = "not enough memory to decode image";
+      return FALSE;
+      }
+    }
+  return TRUE;
+  }
+
+/*==========================================================================
+  jpeg_idct
+  Transform the n x n lowest frequencies of a dequantized block (in
+  natural order) into n x n samples
+*==========================================================================*/
+static void jpeg_idct (const JpegDecoder *self, const int *coef,
+      BYTE *out, int stride)
+  {
+  int n = self->n;
+  int halves = n > 4 ? 2 : 1;
+  v4f tmp[8][2];
+
+  // Rows: tmp[v] is the horizontal transform of row v of coefficients
+  for (int v = 0; v < n; v++)
+    {
+    v4f a0 = {0, 0, 0, 0}, a1 = {0, 0, 0, 0};
+    const int *row = coef + v * 8;
+    for (int u = 0; u < n; u++)
+      {
+      if (row[u] == 0) continue;
+      float c = row[u];
+      a0 += self->basis[u][0] * c;
+      if (halves == 2) a1 += self->basis[u][1] * c;
+      }
+    tmp[v][0] = a0;
+    tmp[v][1] = a1;
+    }
+
+  // Columns, adding back the level shift of 128
+  for (int y = 0; y < n; y++)
+    {
+    v4f a0 = {128, 128, 128, 128}, a1 = {128, 128, 128, 128};
+    for (int v = 0; v < n; v++)
+      {
+      float m = self->basis[v][y / 4][y % 4];
+      a0 += tmp[v][0] * m;
+      if (halves == 2) a1 += tmp[v][1] * m;
+      }
+    v4b b = v4f_to_bytes (a0);
+    memcpy (out, &b, n < 4 ? n : 4);
+    if (halves == 2)
+      {
+      b = v4f_to_bytes (a1);
+      memcpy (out + 4, &b, 4);
+      }
+    out += stride;
+    }
+  }
+
+/*==========================================================================
+  jpeg_decode_block
+  Decode one block into the plane of its component, at block
+  position bx,by
+*==========================================================================*/
+static BOOL jpeg_decode_block (JpegDecoder *self, JpegComponent *c,
+      int bx, int by)
+  {
+  int coef[64];
+  memset (coef, 0, sizeof (coef));
+  int n = self->n;
+  const uint16_t *q = self->qt[c->tq];
+
+  int s = jpeg_huff_decode (self, &self->dc[c->dc]);
+  if (s < 0 || s > 16) return FALSE;
+  if (s) c->pred += jpeg_extend (jpeg_get_bits (self, s), s);
+  coef[0] = c->pred * q[0];
+
+  const JpegHuff *ac = &self->ac[c->ac];
+  for (int k = 1; k < 64; )
+    {
+    int rs = jpeg_huff_decode (self, ac);
+    if (rs < 0) return FALSE;
+    int r = rs >> 4;
+    s = rs & 0x0F;
+    if (s == 0)
+      {
+      if (r != 15) break; // End of block
+      k += 16;
+      continue;
+      }
+    k += r;
+    if (k > 63) return FALSE;
+    int val = jpeg_extend (jpeg_get_bits (self, s), s);
+    int z = zigzag[k];
+    // Coefficients that the reduced IDCT won't use are not stored
+    if ((z >> 3) < n && (z & 7) < n) coef[z] = val * q[k];
+    k++;
+    }
+
+  jpeg_idct (self, coef, c->plane + ((size_t)by * c->plane_w + bx) * n,
+    c->plane_w);
+  return TRUE;
+  }
+
+/*==========================================================================
+  jpeg_restart
+  Deal with a restart marker: discard the rest of the current byte,
+  skip the marker, and reset the DC predictions
+*==========================================================================*/
+static void jpeg_restart (JpegDecoder *self)
+  {
+  self->bits = 0;
+  self->nbits = 0;
+  self->marker_hit = FALSE;
+  while (self->pos + 1 < self->size && !(self->data[self->pos] == 0xFF &&
+         self->data[self->pos + 1] >= 0xD0 && self->data[self->pos + 1] <= 0xD7))
+    self->pos++;
+  self->pos += 2;
+  for (int i = 0; i < self->ncomp; i++) self->comp[i].pred = 0;
+  }
+
+/*==========================================================================
+  jpeg_parse_sos
+  Read a scan header, and decode the scan that follows it
+*==========================================================================*/
+static BOOL jpeg_parse_sos (JpegDecoder *self, size_t end)
+  {
+  if (!self->ncomp)
+    {
+    self->error = "scan before frame header";
+    return FALSE;
+    }
+  if (self->pos >= end) return FALSE;
+  int ns = self->data[self->pos++];
+  if (ns < 1 || ns > self->ncomp || self->pos + ns * 2 + 3 > end)
+    return FALSE;
+  JpegComponent *scomp[MAX_COMPONENTS];
+  for (int i = 0; i < ns; i++)
+    {
+    int id = self->data[self->pos];
+    int tables = self->data[self->pos + 1];
+    self->pos += 2;
+    scomp[i] = NULL;
+    for (int j = 0; j < self->ncomp; j++)
+      if (self->comp[j].id == id) scomp[i] = &self->comp[j];
+    if (!scomp[i]) return FALSE;
+    scomp[i]->dc = (tables >> 4) & 0x03;
+    scomp[i]->ac = tables & 0x03;
+    if (!self->dc[scomp[i]->dc].defined || !self->ac[scomp[i]->ac].defined)
+      {
+      self->error = "missing Huffman table";
+      return FALSE;
+      }
+    }
+  self->pos = end; // Skip spectral selection, which baseline ignores
+
+  self->bits = 0;
+  self->nbits = 0;
+  self->marker_hit = FALSE;
+  for (int i = 0; i < self->ncomp; i++) self->comp[i].pred = 0;
+
+  int count = 0;
+  if (ns == 1)
+    {
+    // Non-interleaved: each MCU is one block, and there are only as
+    //  many blocks as the component's own size needs
+    JpegComponent *c = scomp[0];
+    int cw = (self->w * c->h + self->hmax - 1) / self->hmax;
+    int ch = (self->h * c->v + self->vmax - 1) / self->vmax;
+    int bw = (cw + 7) / 8, bh = (ch + 7) / 8;
+    for (int by = 0; by < bh; by++)
+      for (int bx = 0; bx < bw; bx++)
+        {
+        if (self->restart_interval && count &&
+             count % self->restart_interval == 0)
+          jpeg_restart (self);
+        if (!jpeg_decode_block (self, c, bx, by)) goto corrupt;
+        count++;
+        }
+    }
+  else
+    {
+    for (int my = 0; my < self->mcus_y; my++)
+      for (int mx = 0; mx < self->mcus_x; mx++)
+        {
+        if (self->restart_interval && count &&
+             count % self->restart_interval == 0)
+          jpeg_restart (self);
+        for (int i = 0; i < ns; i++)
+          {
+          JpegComponent *c = scomp[i];
+          for (int v = 0; v < c->v; v++)
+            for (int h = 0; h < c->h; h++)
+              if (!jpeg_decode_block (self, c, mx * c->h + h, my * c->v + v))
+                goto corrupt;
+          }
+        count++;
+        }
+    }
+  self->decoded = TRUE;
+  return TRUE;
+
+corrupt:
+  self->error = "corrupt image data";
+  return FALSE;
+  }
+
+/*==========================================================================
+  jpeg_ycc_to_bgr
+  Convert w pixels, where w is a multiple of four
+*==========================================================================*/
+static void jpeg_ycc_to_bgr (const BYTE *y, const BYTE *cb, const BYTE *cr,
+      BYTE *out, int w)
+  {
+  for (int x = 0; x < w; x += 4)
+    {
+    v4f yv = v4f_load_bytes (y + x);
+    v4f cbv = v4f_load_bytes (cb + x) - 128.0f;
+    v4f crv = v4f_load_bytes (cr + x) - 128.0f;
+    v4b r = v4f_to_bytes (yv + 1.402f * crv);
+    v4b g = v4f_to_bytes (yv - 0.344136f * cbv - 0.714136f * crv);
+    v4b b = v4f_to_bytes (yv + 1.772f * cbv);
+    for (int i = 0; i < 4; i++)
+      {
+      *out++ = b[i];
+      *out++ = g[i];
+      *out++ = r[i];
+      }
+    }
+  }
+
+/*==========================================================================
+  jpeg_is_rgb
+  Three-component images are YCbCr unless an Adobe marker says
+  otherwise or, failing that, the components are called R, G, and B
+*==========================================================================*/
+static BOOL jpeg_is_rgb (const JpegDecoder *self)
+  {
+  if (self->adobe_transform >= 0) return self->adobe_transform == 0;
+  return self->comp[0].id == 'R' && self->comp[1].id == 'G'
+    && self->comp[2].id == 'B';
+  }
+
+/*==========================================================================
+  jpeg_make_bitmap
+  Returns NULL if there is not enough memory
+*==========================================================================*/
+static BitmapRGB *jpeg_make_bitmap (JpegDecoder *self)
+  {
+  int n = self->n;
+  int out_w = (self->w * n + 7) / 8;
+  int out_h = (self->h * n + 7) / 8;
+  BitmapRGB *ret = bitmaprgb_create (out_w, out_h);
+  if (!ret) return NULL;
+  BYTE *data = bitmaprgb_get_data (ret);
+
+  if (self->ncomp == 1)
+    {
+    const JpegComponent *c = &self->comp[0];
+    for (int y = 0; y < out_h; y++)
+      {
+      const BYTE *in = c->plane + (size_t)y * c->plane_w;
+      BYTE *out = data + (size_t)y * out_w * 3;
+      for (int x = 0; x < out_w; x++)
+        {
+        *out++ = in[x];
+        *out++ = in[x];
+        *out++ = in[x];
+        }
+      }
+    return ret;
+    }
+
+  BOOL rgb = jpeg_is_rgb (self);
+  int padded_w = (out_w + 3) & ~3;
+  BYTE *expanded = malloc (padded_w * MAX_COMPONENTS);
+  BYTE *bgr = malloc (padded_w * 3);
+  if (!expanded || !bgr)
+    {
+    free (expanded);
+    free (bgr);
+    bitmaprgb_destroy (ret);
+    return NULL;
+    }
+  for (int y = 0; y < out_h; y++)
+    {
+    const BYTE *rows[MAX_COMPONENTS];
+    for (int i = 0; i < MAX_COMPONENTS; i++)
+      {
+      const JpegComponent *c = &self->comp[i];
+      const BYTE *in = c->plane
+        + (size_t)(y * c->v / self->vmax) * c->plane_w;
+      if (c->h == self->hmax)
+        rows[i] = in;
+      else
+        {
+        // Subsampled: repeat each sample
+        BYTE *e = expanded + i * padded_w;
+        for (int x = 0; x < padded_w; x++)
+          e[x] = in[x * c->h / self->hmax];
+        rows[i] = e;
+        }
+      }
+    if (rgb)
+      {
+      for (int x = 0; x < out_w; x++)
+        {
+        bgr[x * 3] = rows[2][x];
+        bgr[x * 3 + 1] = rows[1][x];
+        bgr[x * 3 + 2] = rows[0][x];
+        }
+      }
+    else
+      jpeg_ycc_to_bgr (rows[0], rows[1], rows[2], bgr, padded_w);
+    memcpy (data + (size_t)y * out_w * 3, bgr, out_w * 3);
+    }
+  free (bgr);
+  free (expanded);
+  return ret;
+  }
+
+/*==========================================================================
+  bitmaprgb_decode_jpeg
+*==========================================================================*/
+BitmapRGB *bitmaprgb_decode_jpeg (const BYTE *data, size_t size,
+      int max_w, int max_h, const char **error)
+  {
+  KLOG_IN
+  BitmapRGB *ret = NULL;
+  JpegDecoder *self = calloc (1, sizeof (JpegDecoder));
+  self->data = data;
+  self->size = size;
+  self->pos = 2;
+  self->adobe_transform = -1;
+  BOOL ok = size >= 4 && data[0] == 0xFF && data[1] == 0xD8;
+  if (!ok) self->error = "not a JPEG file";
+
+  BOOL eoi = FALSE;
+  while (ok && !eoi && self->pos < size)
+    {
+    if (data[self->pos] != 0xFF)
+      {
+      // Entropy-coded data that the scan decoder didn't reach
+      self->pos++;
+      continue;
+      }
+    while (self->pos < size && data[self->pos] == 0xFF) self->pos++;
+    if (self->pos >= size) break;
+    int marker = data[self->pos++];
+    if (marker == 0x00 || marker == 0x01 ||
+         (marker >= 0xD0 && marker <= 0xD7))
+      continue;
+    if (marker == 0xD9)
+      {
+      eoi = TRUE;
+      continue;
+      }
+
+    size_t start = self->pos;
+    int len = jpeg_u16 (self);
+    if (len < 2 || start + len > size)
+      {
+      ok = FALSE;
+      break;
+      }
+    size_t end = start + len;
+    switch (marker)
+      {
+      case 0xC0: // Baseline
+      case 0xC1: // Extended sequential, which is the same at 8 bits
+        ok = jpeg_parse_sof (self, end, max_w, max_h);
+        break;
+      case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+      case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+        self->error = "progressive, lossless, or arithmetic-coded JPEG";
+        ok = FALSE;
+        break;
+      case 0xC4:
+        ok = jpeg_parse_dht (self, end);
+        break;
+      case 0xDB:
+        ok = jpeg_parse_dqt (self, end);
+        break;
+      case 0xDD:
+        self->restart_interval = len >= 4 ? jpeg_u16 (self) : 0;
+        break;
+      case 0xEE: // APP14, which Adobe uses to say how colour is encoded
+        if (len >= 14 && memcmp (data + self->pos, "Adobe", 5) == 0)
+          self->adobe_transform = data[self->pos + 11];
+        break;
+      case 0xDA:
+        ok = jpeg_parse_sos (self, end);
+        // The scan leaves pos wherever the data ended
+        continue;
+      }
+    self->pos = end;
+    }
+
+  if (ok && self->decoded)
+    {
+    ret = jpeg_make_bitmap (self);
+    if (!ret) self->error = "not enough memory to decode image";
+    }
+  if (!ret && error)
+    *error = self->error ? self->error : "corrupt or truncated file";
+
+  for (int i = 0; i < self->ncomp; i++) free (self->comp[i].plane);
+  free (self);
+  KLOG_OUT
+  return ret;
+  }
+
@@ -0,0 +1,144 @@
+/*============================================================================
+
+  bitmaprgb_line.c
+
+  Anti-aliased lines, by Xiaolin Wu's method
+  (https://en.wikipedia.org/wiki/Xiaolin_Wu%27s_line_algorithm),
+  in 16.16 fixed point.
+
+  Each line is stepped one pixel at a time along its major axis (the
+  one in which it is longer), and at each step the two pixels either
+  side of the exact position on the minor axis are blended with the
+  line colour, in proportion to how close they are to it. Both axes
+  are handled by the same code, just by swapping the distances in
+  memory between neighbouring pixels.
+
+  The range of steps that can touch the bitmap at all is worked out
+  before any drawing, so a line that is mostly off the bitmap costs
+  little, and inside the loop only the minor-axis position needs a
+  (cheap, unsigned) bounds check.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_line"
+
+/*==========================================================================
+  line_blend
+  Move a pixel towards b,g,r by w/256
+*==========================================================================*/
+static inline void line_blend (BYTE *p, int r, int g, int b, int w)
+  {
+  p[0] += ((b - p[0]) * w) >> 8;
+  p[1] += ((g - p[1]) * w) >> 8;
+  p[2] += ((r - p[2]) * w) >> 8;
+  }
+
+/*==========================================================================
+  line_draw
+*==========================================================================*/
+static void line_draw (BitmapRGB *self, int x1, int y1, int x2, int y2,
+      int r, int g, int b)
+  {
+  // The second pixel of each step may be one beyond the end points
+  if (self->damage)
+    bitmaprgb_damage_add (self, x1 < x2 ? x1 : x2, y1 < y2 ? y1 : y2,
+      (x1 > x2 ? x1 : x2) + 2, (y1 > y2 ? y1 : y2) + 2);
+
+  // a is the major axis, b the minor. Work in terms of these from now on
+  BOOL steep = abs (y2 - y1) > abs (x2 - x1);
+  int a1 = steep ? y1 : x1, a2 = steep ? y2 : x2;
+  int b1 = steep ? x1 : y1, b2 = steep ? x2 : y2;
+  int a_len = steep ? self->h : self->w;
+  int b_len = steep ? self->w : self->h;
+  size_t a_step = steep ? (size_t)self->w * BPP : BPP;
+  size_t b_step = steep ? BPP : (size_t)self->w * BPP;
+  if (a1 > a2)
+    {
+    int t = a1; a1 = a2; a2 = t;
+    t = b1; b1 = b2; b2 = t;
+    }
+  int32_t grad = a2 > a1 ? (int32_t)((int64_t)(b2 - b1) * 65536 / (a2 - a1))
+    : 0;
+
+  // Clip on the major axis, and then to the steps where the minor axis
+  //   position is within the bitmap, allowing for the second pixel,
+  //   and a step either way for rounding
+  int64_t lo = a1 < 0 ? 0 : a1;
+  int64_t hi = a2 >= a_len ? a_len - 1 : a2;
+  if (grad == 0)
+    {
+    if (b1 < 0 || b1 >= b_len) return;
+    }
+  else
+    {
+    int64_t t1 = a1 + (int64_t)(-1 - b1) * 65536 / grad;
+    int64_t t2 = a1 + (int64_t)(b_len - b1) * 65536 / grad;
+    if (t1 > t2) { int64_t t = t1; t1 = t2; t2 = t; }
+    if (lo < t1 - 1) lo = t1 - 1;
+    if (hi > t2 + 1) hi = t2 + 1;
+    }
+
+  if (lo > hi) return;
+
+  int32_t m = (int32_t)((int64_t)b1 * 65536 + (int64_t)grad * (lo - a1));
+  BYTE *row = self->data + lo * a_step;
+  for (int64_t a = lo; a <= hi; a++, m += grad, row += a_step)
+    {
+    int mp = m >> 16;
+    int f = (m >> 8) & 0xFF;
+    if ((unsigned)mp < (unsigned)b_len)
+      line_blend (row + mp * b_step, r, g, b, 256 - f);
+    if (f && (unsigned)(mp + 1) < (unsigned)b_len)
+      line_blend (row + (mp + 1) * b_step, r, g, b, f);
+    }
+  }
+
+/*==========================================================================
+  bitmaprgb_draw_line_one_pixel
+*==========================================================================*/
+void bitmaprgb_draw_line_one_pixel (BitmapRGB *self, int x1, int y1,
+      int x2, int y2, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  line_draw (self, x1, y1, x2, y2, r, g, b);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_draw_polyline
+*==========================================================================*/
+void bitmaprgb_draw_polyline (BitmapRGB *self, const int *points,
+      int npoints, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  for (int i = 1; i < npoints; i++, points += 2)
+    line_draw (self, points[0], points[1], points[2], points[3], r, g, b);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_draw_lines
+*==========================================================================*/
+void bitmaprgb_draw_lines (BitmapRGB *self, const BitmapRGBLine *lines,
+      int n)
+  {
+  KLOG_IN
+  for (int i = 0; i < n; i++)
+    {
+    const BitmapRGBLine *l = &lines[i];
+    line_draw (self, l->x1, l->y1, l->x2, l->y2, l->r, l->g, l->b);
+    }
+  KLOG_OUT
+  }
+
@@ -0,0 +1,428 @@
+/*============================================================================
+
+  bitmaprgb_load.c
+
+  Functions for loading a BitmapRGB from an image file. The format is
+  worked out from the first few bytes of the file, not its name, and
+  the file is passed to the loader for that format. Adding a format
+  means adding an entry to the loaders[] table.
+
+  The file is mapped into memory, and each loader decodes straight
+  from the mapping into the bitmap, in one pass, so there is no
+  intermediate copy of the file. For BMP files, whose pixels are
+  already stored the same way as in a BitmapRGB, decoding is just one
+  memcpy() per row.
+
+  Loaders are given the size the image will be shown at, so that
+  formats that allow it can be decoded at a reduced size.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_loaders.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_load"
+
+typedef BitmapRGB *(*BitmapRGBLoader) (const BYTE *data, size_t size,
+   int max_w, int max_h, const char **error);
+
+typedef struct _BitmapRGBFormat
+  {
+  const char *name;
+  const char *magic;
+  int magic_len;
+  BitmapRGBLoader load;
+  } BitmapRGBFormat;
+
+/*==========================================================================
+  get_le16, get_le32, get_be32
+*==========================================================================*/
+static inline uint32_t get_le16 (const BYTE *p)
+  {
+  return p[0] | (p[1] << 8);
+  }
+
+static inline uint32_t get_le32 (const BYTE *p)
+  {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+static inline uint32_t get_be32 (const BYTE *p)
+  {
+  return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  }
+
+/*==========================================================================
+  ppm_read_number
+  Read a decimal number from a PPM header, skipping whitespace and
+  comments before it, and the single whitespace character after it.
+  Returns -1 if there is no number.
+*==========================================================================*/
+static int ppm_read_number (const BYTE *data, size_t size, size_t *pos)
+  {
+  while (*pos < size)
+    {
+    if (data[*pos] == '#')
+      {
+      while (*pos < size && data[*pos] != '\n') (*pos)++;
+      }
+    else if (isspace (data[*pos]))
+      (*pos)++;
+    else
+      break;
+    }
+  if (*pos >= size || !isdigit (data[*pos])) return -1;
+  int n = 0;
+  while (*pos < size && isdigit (data[*pos]))
+    {
+    if (n > 100000000) return -1;
+    n = n * 10 + (data[(*pos)++] - '0');
+    }
+  if (*pos < size) (*pos)++;
+  return n;
+  }
+
+/*==========================================================================
+  bitmaprgb_load_ppm
+  Load a binary (P6) PPM file. Samples of more than one byte are
+  reduced to their most significant byte, and samples with a maximum
+  value of less than 255 are scaled up.
+*==========================================================================*/
+static BitmapRGB *bitmaprgb_load_ppm (const BYTE *data, size_t size,
+      int max_w, int max_h, const char **error)
+  {
+  size_t pos = 2;
+  int w = ppm_read_number (data, size, &pos);
+  int h = ppm_read_number (data, size, &pos);
+  int maxval = ppm_read_number (data, size, &pos);
+  if (w <= 0 || h <= 0 || (int64_t)w * h > MAX_PIXELS
+       || maxval <= 0 || maxval >= 65536)
+    {
+    *error = "unsupported or corrupt PPM header";
+    return NULL;
+    }
+  int sample_bytes = maxval > 255 ? 2 : 1;
+  // The largest value of the byte that is used
+  int scale_max = sample_bytes == 2 ? maxval >> 8 : maxval;
+  if (size - pos < (size_t)w * h * 3 * sample_bytes)
+    {
+    *error = "file is truncated";
+    return NULL;
+    }
+
+  BitmapRGB *ret = bitmaprgb_create (w, h);
+  if (!ret)
+    {
+    *error = "not enough memory to load image";
+    return NULL;
+    }
+  BYTE *out = bitmaprgb_get_data (ret);
+  const BYTE *in = data + pos;
+  size_t npixels = (size_t)w * h;
+  if (scale_max == 255)
+    {
+    int step = 3 * sample_bytes;
+    for (size_t i = 0; i < npixels; i++)
+      {
+      // BitmapRGB pixels are stored as b,g,r
+      out[0] = in[2 * sample_bytes];
+      out[1] = in[sample_bytes];
+      out[2] = in[0];
+      out += 3;
+      in += step;
+      }
+    }
+  else
+    {
+    for (size_t i = 0; i < npixels; i++)
+      {
+      for (int c = 2; c >= 0; c--)
+        {
+        int v = in[c * sample_bytes] * 255 / scale_max;
+        *out++ = v > 255 ? 255 : v;
+        }
+      in += 3 * sample_bytes;
+      }
+    }
+  return ret;
+  }
+
+/*==========================================================================
+  bitmaprgb_load_bmp
+  Load an uncompressed BMP file, of 8 (palette), 24, or 32 bits per
+  pixel. Any alpha channel is ignored.
+*==========================================================================*/
+static BitmapRGB *bitmaprgb_load_bmp (const BYTE *data, size_t size,
+      int max_w, int max_h, const char **error)
+  {
+  if (size < 54 || get_le32 (data + 14) < 40)
+    {
+    *error = "unsupported or corrupt BMP header";
+    return NULL;
+    }
+  uint32_t offset = get_le32 (data + 10);
+  uint32_t header_size = get_le32 (data + 14);
+  int w = (int32_t)get_le32 (data + 18);
+  int h = (int32_t)get_le32 (data + 22);
+  int bpp = get_le16 (data + 28);
+  uint32_t compression = get_le32 (data + 30);
+  uint32_t ncolours = get_le32 (data + 46);
+
+  // Height is negative for images stored top row first
+  BOOL top_down = h < 0;
+  if (top_down) h = -h;
+  // BI_BITFIELDS is accepted for 32-bit images only in the usual layout
+  BOOL std_masks = compression == 3 && bpp == 32 && size >= 66 &&
+    get_le32 (data + 54) == 0x00FF0000 && get_le32 (data + 58) == 0x0000FF00
+    && get_le32 (data + 62) == 0x000000FF;
+  if (w <= 0 || h <= 0 || (int64_t)w * h > MAX_PIXELS
+       || (compression != 0 && !std_masks)
+       || (bpp != 8 && bpp != 24 && bpp != 32))
+    {
+    *error = "unsupported BMP type (only uncompressed 8, 24, "
+      "and 32-bit images can be loaded)";
+    return NULL;
+    }
+
+  size_t stride = ((size_t)w * bpp + 31) / 32 * 4;
+  if (offset > size || size - offset < stride * h)
+    {
+    *error = "file is truncated";
+    return NULL;
+    }
+  const BYTE *palette = data + 14 + header_size;
+  if (bpp == 8)
+    {
+    if (ncolours == 0 || ncolours > 256) ncolours = 256;
+    if ((uint64_t)14 + header_size + ncolours * 4 > offset)
+      {
+      *error = "corrupt BMP palette";
+      return NULL;
+      }
+    }
+
+  BitmapRGB *ret = bitmaprgb_create (w, h);
+  if (!ret)
+    {
+    *error = "not enough memory to load image";
+    return NULL;
+    }
+  BYTE *pixels = bitmaprgb_get_data (ret);
+  for (int y = 0; y < h; y++)
+    {
+    const BYTE *in = data + offset + stride * (top_down ? y : h - 1 - y);
+    BYTE *out = pixels + (size_t)y * w * 3;
+    switch (bpp)
+      {
+      case 24:
+        // Same layout as BitmapRGB
+        memcpy (out, in, (size_t)w * 3);
+        break;
+      case 32:
+        for (int x = 0; x < w; x++, in += 4, out += 3)
+          memcpy (out, in, 3);
+        break;
+      default:
+        for (int x = 0; x < w; x++, out += 3)
+          {
+          int i = in[x] < ncolours ? in[x] : 0;
+          memcpy (out, palette + i * 4, 3);
+          }
+      }
+    }
+  return ret;
+  }
+
+/*==========================================================================
+  bitmaprgb_load_qoi
+  Load a QOI ("Quite OK Image") file, in a single pass. Any alpha
+  channel is ignored, although it has to be tracked to decode the
+  file.
+*==========================================================================*/
+static BitmapRGB *bitmaprgb_load_qoi (const BYTE *data, size_t size,
+      int max_w, int max_h, const char **error)
+  {
+  if (size < 22)
+    {
+    *error = "file is truncated";
+    return NULL;
+    }
+  uint32_t w = get_be32 (data + 4);
+  uint32_t h = get_be32 (data + 8);
+  if (w == 0 || h == 0 || (uint64_t)w * h > MAX_PIXELS)
+    {
+    *error = "unsupported image size";
+    return NULL;
+    }
+
+  BitmapRGB *ret = bitmaprgb_create (w, h);
+  if (!ret)
+    {
+    *error = "not enough memory to load image";
+    return NULL;
+    }
+  BYTE *out = bitmaprgb_get_data (ret);
+  BYTE index[64][4];
+  memset (index, 0, sizeof (index));
+  BYTE r = 0, g = 0, b = 0, a = 255;
+  size_t pos = 14;
+  size_t end = size - 8; // The stream ends with eight bytes of padding
+  int run = 0;
+  size_t npixels = (size_t)w * h;
+  for (size_t i = 0; i < npixels; i++)
+    {
+    if (run > 0)
+      run--;
+    else if (pos < end)
+      {
+      int b1 = data[pos++];
+      if (b1 == 0xFE)
+        {
+        if (pos + 3 > end) break;
+        r = data[pos];
+        g = data[pos + 1];
+        b = data[pos + 2];
+        pos += 3;
+        }
+      else if (b1 == 0xFF)
+        {
+        if (pos + 4 > end) break;
+        r = data[pos];
+        g = data[pos + 1];
+        b = data[pos + 2];
+        a = data[pos + 3];
+        pos += 4;
+        }
+      else if ((b1 & 0xC0) == 0x80) // Luma difference
+        {
+        if (pos + 1 > end) break;
+        int b2 = data[pos++];
+        int vg = (b1 & 0x3F) - 32;
+        r += vg - 8 + ((b2 >> 4) & 0x0F);
+        g += vg;
+        b += vg - 8 + (b2 & 0x0F);
+        }
+      else switch (b1 & 0xC0)
+        {
+        case 0x00: // Index
+          r = index[b1][0];
+          g = index[b1][1];
+          b = index[b1][2];
+          a = index[b1][3];
+          break;
+        case 0x40: // Small difference
+          r += ((b1 >> 4) & 0x03) - 2;
+          g += ((b1 >> 2) & 0x03) - 2;
+          b += (b1 & 0x03) - 2;
+          break;
+        default: // Run, of which this is the first pixel
+          run = b1 & 0x3F;
+        }
+      int hash = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+      index[hash][0] = r;
+      index[hash][1] = g;
+      index[hash][2] = b;
+      index[hash][3] = a;
+      }
+    else
+      break;
+    *out++ = b;
+    *out++ = g;
+    *out++ = r;
+    }
+  if (out != bitmaprgb_get_data (ret) + npixels * 3)
+    {
+    bitmaprgb_destroy (ret);
+    *error = "file is truncated";
+    return NULL;
+    }
+  return ret;
+  }
+
+static const BitmapRGBFormat loaders[] =
+  {
+  {"PPM", "P6", 2, bitmaprgb_load_ppm},
+  {"BMP", "BM", 2, bitmaprgb_load_bmp},
+  {"QOI", "qoif", 4, bitmaprgb_load_qoi},
+  {"JPEG", "\xFF\xD8\xFF", 3, bitmaprgb_decode_jpeg},
+  {NULL, NULL, 0, NULL}
+  };
+
+/*==========================================================================
+  bitmaprgb_load
+*==========================================================================*/
+BitmapRGB *bitmaprgb_load (const char *file, char **error)
+  {
+  return bitmaprgb_load_scaled (file, 0, 0, error);
+  }
+
+/*==========================================================================
+  bitmaprgb_load_scaled
+*==========================================================================*/
+BitmapRGB *bitmaprgb_load_scaled (const char *file, int max_w, int max_h,
+      char **error)
+  {
+  KLOG_IN
+  BitmapRGB *ret = NULL;
+  int fd = open (file, O_RDONLY | O_CLOEXEC);
+  struct stat sb;
+  if (fd < 0 || fstat (fd, &sb) != 0)
+    {
+    if (error) asprintf (error, "Can't open %s: %s", file, strerror (errno));
+    }
+  else if (sb.st_size == 0)
+    {
+    if (error) asprintf (error, "%s: file is empty", file);
+    }
+  else
+    {
+    size_t size = sb.st_size;
+    BYTE *data = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+      {
+      madvise (data, size, MADV_SEQUENTIAL);
+      const BitmapRGBFormat *format = NULL;
+      for (int i = 0; loaders[i].name && !format; i++)
+        {
+        if (size >= loaders[i].magic_len &&
+             memcmp (data, loaders[i].magic, loaders[i].magic_len) == 0)
+          format = &loaders[i];
+        }
+      if (format)
+        {
+        klog_debug (KLOG_CLASS, "Loading %s as %s", file, format->name);
+        const char *msg = NULL;
+        ret = format->load (data, size, max_w, max_h, &msg);
+        if (!ret && error) asprintf (error, "%s: %s", file, msg);
+        }
+      else
+        {
+        if (error) asprintf (error, "%s: unknown image format", file);
+        }
+      munmap (data, size);
+      }
+    else
+      {
+      if (error) asprintf (error, "Can't map %s: %s", file, strerror (errno));
+      }
+    }
+  if (fd >= 0) close (fd);
+  KLOG_OUT
+  return ret;
+  }
+
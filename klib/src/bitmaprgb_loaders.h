@@ -0,0 +1,33 @@
+/*============================================================================
+
+  bitmaprgb_loaders.h
+
+  Image decoders used by bitmaprgb_load(). This header is private to
+  klib.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <klib/defs.h>
+#include <klib/bitmaprgb.h>
+
+// Largest image, in pixels, that any loader will accept. At three bytes
+//   a pixel, the bitmap's size must still fit in an int
+#define MAX_PIXELS (16384 * 16384)
+
+BEGIN_DECLS
+
+/** Decode a baseline JPEG image from memory. If max_w and max_h are
+    non-zero, the image may be decoded at 1/2, 1/4, or 1/8 of its
+    full size, provided that it is still at least as large as it
+    would be if scaled to fit max_w x max_h. On failure, returns NULL
+    and sets error to a static message. */
+BitmapRGB *bitmaprgb_decode_jpeg (const BYTE *data, size_t size,
+             int max_w, int max_h, const char **error);
+
+END_DECLS
+
@@ -0,0 +1,68 @@
+/*============================================================================
+
+  bitmaprgb_private.h
+
+  The layout of a BitmapRGB, for the klib source files that work on
+  its pixels directly. This header is private to klib.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <klib/defs.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include <klib/kthreadpool.h>
+
+// Bytes per pixel
+#define BPP 3
+
+struct _BitmapRGB
+  {
+  int w;
+  int h;
+  BYTE *data; // h rows of w pixels, each stored as b,g,r
+  BOOL owns_data; // FALSE if data belongs to the caller
+  struct _BitmapRGBDamage *damage; // NULL unless tracking damage
+  };
+
+/** Add the rectangle from x1,y1 up to, but not including, x2,y2 to 
+    the damage of a bitmap that is tracking it. */
+void bitmaprgb_damage_add (BitmapRGB *self, int x1, int y1, int x2, int y2);
+
+/** Record damage from x1,y1 up to x2,y2, if it is being tracked. All 
+    the drawing functions call this, so it must cost nothing when it 
+    is not. */
+static inline void bitmaprgb_damage (BitmapRGB *self, int x1, int y1, 
+      int x2, int y2)
+  {
+  if (self->damage) bitmaprgb_damage_add (self, x1, y1, x2, y2);
+  }
+
+/** Copy the w x h rectangle at sx,sy of a bitmap to dx,dy on the
+    framebuffer, converting to the framebuffer's pixel format. The
+    rectangle must fall within both. */
+void bitmaprgb_write_fb (const BitmapRGB *self, int sx, int sy, int w, int h,
+       FrameBuffer *fb, int dx, int dy, BitmapRGBDither dither,
+       KThreadPool *pool);
+
+/** As bitmaprgb_write_fb(), but to rows of stride bytes, with pixels of
+    bytes_pp bytes in the framebuffer's format, the first of which is at 
+    out. dx,dy are the coordinates of that pixel, which dithering needs
+    so that a pattern lines up with what is around it. */
+void bitmaprgb_write_pixels (const BitmapRGB *self, int sx, int sy,
+       int w, int h, BYTE *out, int stride, int bytes_pp, int dx, int dy,
+       BitmapRGBDither dither, KThreadPool *pool);
+
+// Does the rows y1 up to, but not including, y2 of some operation
+typedef void (*BitmapRGBBandFn) (void *arg, int y1, int y2);
+
+/** Split h rows, of row_bytes bytes each, into bands that fit in the
+    cache, and call band for each one, on the threads of pool (which
+    may be NULL). The bands may be done in any order, or all at once,
+    so must not write to the same rows. */
+void bitmaprgb_bands (KThreadPool *pool, int h, size_t row_bytes,
+       BitmapRGBBandFn band, void *arg);
+
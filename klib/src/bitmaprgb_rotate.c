@@ -0,0 +1,225 @@
+/*============================================================================
+
+  bitmaprgb_rotate.c
+
+  Rotating and flipping a BitmapRGB, into another bitmap or onto the
+  framebuffer.
+
+  Every transform is a copy in which moving one pixel right, or one
+  row down, in the source moves a fixed number of bytes (possibly
+  negative) in the destination. For a rotation by 90 or 270 degrees, a
+  row of the source becomes a column of the destination, so copying
+  whole rows would touch a different cache line, and before long a
+  different page, for every pixel written. Instead the source is
+  copied in bands of rows, going down the columns of each band, so the
+  destination -- which may well be uncached framebuffer memory -- is
+  written along its rows, and the bands are small enough that the
+  source lines each one touches stay in the cache until it is done.
+  Flips and 180 degree rotations keep rows as rows, and are copied a
+  row at a time. A framebuffer whose pixels are not simply b,g,r bytes
+  is written by way of a temporary bitmap, so the packing and dithering
+  are done in bitmaprgb_dither.c.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_rotate"
+
+// Rows of the source in each band of a 90 or 270 degree rotation. The
+//   cache lines of source that a band touches, 256 x 64 bytes, are reused
+//   for about 20 columns, so must fit in the L1 cache
+#define BAND 256
+
+/*==========================================================================
+  rotate_is_quarter
+  Returns TRUE if the transform swaps width and height
+*==========================================================================*/
+static BOOL rotate_is_quarter (BitmapRGBTransform t)
+  {
+  return t == BITMAPRGB_TRANSFORM_ROTATE_90 ||
+    t == BITMAPRGB_TRANSFORM_ROTATE_270;
+  }
+
+/*==========================================================================
+  rotate_inverse
+*==========================================================================*/
+static BitmapRGBTransform rotate_inverse (BitmapRGBTransform t)
+  {
+  if (t == BITMAPRGB_TRANSFORM_ROTATE_90)
+    return BITMAPRGB_TRANSFORM_ROTATE_270;
+  if (t == BITMAPRGB_TRANSFORM_ROTATE_270)
+    return BITMAPRGB_TRANSFORM_ROTATE_90;
+  return t;
+  }
+
+/*==========================================================================
+  rotate_point
+  Where the pixel x,y of a w x h bitmap ends up, when transformed
+*==========================================================================*/
+static void rotate_point (BitmapRGBTransform t, int w, int h, int x, int y,
+      int *u, int *v)
+  {
+  switch (t)
+    {
+    case BITMAPRGB_TRANSFORM_ROTATE_90: *u = h - 1 - y; *v = x; break;
+    case BITMAPRGB_TRANSFORM_ROTATE_180: *u = w - 1 - x; *v = h - 1 - y; break;
+    case BITMAPRGB_TRANSFORM_ROTATE_270: *u = y; *v = w - 1 - x; break;
+    case BITMAPRGB_TRANSFORM_FLIP_H: *u = w - 1 - x; *v = y; break;
+    case BITMAPRGB_TRANSFORM_FLIP_V: *u = x; *v = h - 1 - y; break;
+    default: *u = x; *v = y;
+    }
+  }
+
+/*==========================================================================
+  rotate_rect
+  Where the rectangle x,y,rw,rh of a w x h bitmap ends up, when
+  transformed
+*==========================================================================*/
+static void rotate_rect (BitmapRGBTransform t, int w, int h,
+      int *x, int *y, int *rw, int *rh)
+  {
+  int u1, v1, u2, v2;
+  rotate_point (t, w, h, *x, *y, &u1, &v1);
+  rotate_point (t, w, h, *x + *rw - 1, *y + *rh - 1, &u2, &v2);
+  *x = u1 < u2 ? u1 : u2;
+  *y = v1 < v2 ? v1 : v2;
+  *rw = abs (u2 - u1) + 1;
+  *rh = abs (v2 - v1) + 1;
+  }
+
+/*==========================================================================
+  rotate_copy
+  Copy the rectangle x,y,rw,rh of src to dst, which has pixels of dst_bpp
+  (3 or 4) bytes, and dst_stride bytes per row. The transformed src has
+  its top-left corner at -ox,-oy in dst, and the rectangle must fall
+  within both
+*==========================================================================*/
+static void rotate_copy (const BitmapRGB *src, int x, int y, int rw, int rh,
+      BYTE *dst, int dst_bpp, size_t dst_stride, BitmapRGBTransform t,
+      int ox, int oy)
+  {
+  int u, v, u_right, v_right, u_down, v_down;
+  rotate_point (t, src->w, src->h, x, y, &u, &v);
+  rotate_point (t, src->w, src->h, x + 1, y, &u_right, &v_right);
+  rotate_point (t, src->w, src->h, x, y + 1, &u_down, &v_down);
+  BYTE *origin = dst + (v - oy) * dst_stride + (size_t)(u - ox) * dst_bpp;
+  ptrdiff_t x_step = (v_right - v) * (ptrdiff_t)dst_stride
+    + (u_right - u) * dst_bpp;
+  ptrdiff_t y_step = (v_down - v) * (ptrdiff_t)dst_stride
+    + (u_down - u) * dst_bpp;
+
+  size_t src_stride = (size_t)src->w * BPP;
+  const BYTE *src_origin = src->data + y * src_stride + (size_t)x * BPP;
+  if (!rotate_is_quarter (t))
+    {
+    for (int row = 0; row < rh; row++)
+      {
+      const BYTE *in = src_origin + row * src_stride;
+      BYTE *out = origin + row * y_step;
+      for (int i = 0; i < rw; i++, in += BPP, out += x_step)
+        memcpy (out, in, BPP);
+      }
+    return;
+    }
+
+  // Go down the columns of the source, so that the writes are along the
+  //   rows of the destination, a band of rows at a time
+  for (int by = 0; by < rh; by += BAND)
+    {
+    int n = by + BAND < rh ? BAND : rh - by;
+    for (int col = 0; col < rw; col++)
+      {
+      const BYTE *in = src_origin + by * src_stride + (size_t)col * BPP;
+      BYTE *out = origin + by * y_step + col * x_step;
+      for (int i = 0; i < n; i++, in += src_stride, out += y_step)
+        memcpy (out, in, BPP);
+      }
+    }
+  }
+
+/*==========================================================================
+  bitmaprgb_transform
+*==========================================================================*/
+BitmapRGB *bitmaprgb_transform (const BitmapRGB *other,
+      BitmapRGBTransform transform)
+  {
+  KLOG_IN
+  BitmapRGB *self = rotate_is_quarter (transform) ?
+    bitmaprgb_create (other->h, other->w) :
+    bitmaprgb_create (other->w, other->h);
+  if (self)
+    rotate_copy (other, 0, 0, other->w, other->h, self->data, BPP,
+      (size_t)self->w * BPP, transform, 0, 0);
+  KLOG_OUT
+  return self;
+  }
+
+/*==========================================================================
+  bitmaprgb_to_fb_rect_transformed
+*==========================================================================*/
+void bitmaprgb_to_fb_rect_transformed (const BitmapRGB *self,
+      FrameBuffer *fb, int x, int y, int w, int h,
+      BitmapRGBTransform transform, BitmapRGBDither dither)
+  {
+  KLOG_IN
+  // Clip to the bitmap, then to the framebuffer, in framebuffer
+  //   coordinates, and then work out which part of the bitmap is left
+  int tw = self->w, th = self->h;
+  if (rotate_is_quarter (transform)) { tw = self->h; th = self->w; }
+  int x2 = x + w, y2 = y + h;
+  if (x < 0) x = 0;
+  if (y < 0) y = 0;
+  if (x2 > self->w) x2 = self->w;
+  if (y2 > self->h) y2 = self->h;
+  w = x2 - x;
+  h = y2 - y;
+  if (w > 0 && h > 0)
+    {
+    rotate_rect (transform, self->w, self->h, &x, &y, &w, &h);
+    int fb_w = framebuffer_get_width (fb);
+    int fb_h = framebuffer_get_height (fb);
+    if (x + w > fb_w) w = fb_w - x;
+    if (y + h > fb_h) h = fb_h - y;
+    if (w > 0 && h > 0)
+      {
+      int u = x, v = y, fw = w, fh = h;
+      rotate_rect (rotate_inverse (transform), tw, th, &x, &y, &w, &h);
+      int bytes_pp = framebuffer_get_bits_per_pixel (fb) / 8;
+      if (bytes_pp >= 3)
+        {
+        rotate_copy (self, x, y, w, h, framebuffer_get_data (fb), bytes_pp,
+          framebuffer_get_stride (fb), transform, 0, 0);
+        }
+      else
+        {
+        // Pixels that have to be packed (and perhaps dithered) are 
+        //   rotated into a bitmap the size of the area they cover first.
+        //   If there is no memory for it, the area is left as it was
+        BitmapRGB *tmp = bitmaprgb_create (fw, fh);
+        if (tmp)
+          {
+          rotate_copy (self, x, y, w, h, tmp->data, BPP, (size_t)fw * BPP,
+            transform, u, v);
+          bitmaprgb_write_fb (tmp, 0, 0, fw, fh, fb, u, v, dither, NULL);
+          bitmaprgb_destroy (tmp);
+          }
+        else
+          klog_warn (KLOG_CLASS, "Not enough memory to transform image");
+        }
+      }
+    }
+  KLOG_OUT
+  }
+
@@ -0,0 +1,337 @@
+/*============================================================================
+
+  bitmaprgb_scale.c
+
+  Scaling of one BitmapRGB into another.
+
+  Scaling is separable: each output row is a weighted sum of a few
+  source rows, each of which has first been scaled horizontally. The
+  weights for each output column and row are worked out once, before
+  any pixels are touched. Output rows are produced in order, so the
+  source is read from top to bottom, and each source row is scaled
+  horizontally just once and kept in a small ring buffer for as long
+  as any output row needs it. All the working memory is a few rows,
+  whatever the size of the image. When the work is shared between
+  threads, each does bands of output rows (see bitmaprgb_bands.c) in
+  just the same way, with a ring buffer of its own.
+
+  Pixels are held as four-element SIMD vectors (b, g, r, unused) while
+  they are being scaled, so each filter tap is a single vector
+  multiply-add.
+
+  The box filter doesn't need any of this, and just copies pixels.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+#include "simd.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_scale"
+
+// The filter taps for each output pixel along one axis
+typedef struct _ScaleAxis
+  {
+  int max_taps;
+  int *start; // First source pixel
+  int *ntaps;
+  float *weights; // max_taps for each output pixel
+  } ScaleAxis;
+
+/*==========================================================================
+  scale_axis_init
+  Work out the taps for dst_len output pixels, which together cover
+  src_len source pixels starting at src_start (which need not be
+  whole numbers). Source pixels are limited to 0..limit-1.
+*==========================================================================*/
+static void scale_axis_init (ScaleAxis *self, int dst_len, float src_start,
+      float src_len, int limit, BitmapRGBFilter filter)
+  {
+  float step = src_len / dst_len;
+  switch (filter)
+    {
+    case BITMAPRGB_FILTER_AREA:
+      self->max_taps = (int)step + 2;
+      break;
+    case BITMAPRGB_FILTER_BILINEAR:
+      self->max_taps = 2;
+      break;
+    default:
+      self->max_taps = 1;
+    }
+  self->start = malloc (dst_len * sizeof (int));
+  self->ntaps = malloc (dst_len * sizeof (int));
+  self->weights = malloc (dst_len * self->max_taps * sizeof (float));
+
+  for (int i = 0; i < dst_len; i++)
+    {
+    float *w = self->weights + i * self->max_taps;
+    int first, n;
+    if (filter == BITMAPRGB_FILTER_AREA)
+      {
+      // Weight each source pixel by how much of it the output covers
+      float a = src_start + i * step;
+      float b = a + step;
+      first = (int)a;
+      if (first >= limit) first = limit - 1;
+      int last = (int)b;
+      if (last > first && last == b) last--;
+      if (last >= limit) last = limit - 1;
+      if (last - first + 1 > self->max_taps)
+        last = first + self->max_taps - 1;
+      n = last - first + 1;
+      float total = 0;
+      for (int j = 0; j < n; j++)
+        {
+        float lo = first + j > a ? first + j : a;
+        float hi = first + j + 1 < b ? first + j + 1 : b;
+        w[j] = hi > lo ? hi - lo : 0;
+        total += w[j];
+        }
+      for (int j = 0; j < n; j++)
+        w[j] = total > 0 ? w[j] / total : 1.0f / n;
+      }
+    else
+      {
+      // The source position of the centre of the output pixel
+      float c = src_start + (i + 0.5f) * step;
+      if (filter == BITMAPRGB_FILTER_BILINEAR)
+        {
+        c -= 0.5f;
+        if (c < 0) c = 0;
+        first = (int)c;
+        float f = c - first;
+        n = first + 1 < limit ? 2 : 1;
+        w[0] = n == 2 ? 1 - f : 1;
+        w[1] = f;
+        }
+      else
+        {
+        first = (int)c;
+        n = 1;
+        w[0] = 1;
+        }
+      }
+    if (first >= limit) first = limit - 1;
+    self->start[i] = first;
+    self->ntaps[i] = n;
+    }
+  }
+
+/*==========================================================================
+  scale_axis_free
+*==========================================================================*/
+static void scale_axis_free (ScaleAxis *self)
+  {
+  free (self->start);
+  free (self->ntaps);
+  free (self->weights);
+  }
+
+// Where to scale from and to, for scale_box() and scale_filtered().
+//   The output is dw x dh pixels, at dx,dy
+typedef struct _ScaleJob
+  {
+  BitmapRGB *self;
+  const BitmapRGB *src;
+  int dx, dy, dw;
+  const ScaleAxis *ax;
+  const ScaleAxis *ay;
+  } ScaleJob;
+
+/*==========================================================================
+  scale_box
+  Copy the nearest source pixel into each output pixel, for the output
+  rows y1 up to y2
+*==========================================================================*/
+static void scale_box (void *arg, int y1, int y2)
+  {
+  const ScaleJob *job = arg;
+  BitmapRGB *self = job->self;
+  const BitmapRGB *src = job->src;
+  int dx = job->dx, dy = job->dy, dw = job->dw;
+  const ScaleAxis *ax = job->ax, *ay = job->ay;
+  for (int y = y1; y < y2; y++)
+    {
+    const BYTE *in = src->data + (size_t)ay->start[y] * src->w * BPP;
+    BYTE *out = self->data + ((size_t)(dy + y) * self->w + dx) * BPP;
+    for (int x = 0; x < dw; x++, out += BPP)
+      memcpy (out, in + ax->start[x] * BPP, BPP);
+    }
+  }
+
+/*==========================================================================
+  scale_row
+  Scale one source row horizontally
+*==========================================================================*/
+static void scale_row (const BYTE *in, int x_lo, int x_hi, v4f *pixels,
+      const ScaleAxis *ax, int dw, v4f *out)
+  {
+  // Convert just the part of the row that is used
+  in += x_lo * BPP;
+  for (int x = 0; x <= x_hi - x_lo; x++, in += BPP)
+    pixels[x] = (v4f){in[0], in[1], in[2], 0};
+
+  for (int x = 0; x < dw; x++)
+    {
+    const float *w = ax->weights + x * ax->max_taps;
+    const v4f *p = pixels + ax->start[x] - x_lo;
+    v4f acc = p[0] * w[0];
+    for (int j = 1; j < ax->ntaps[x]; j++)
+      acc += p[j] * w[j];
+    out[x] = acc;
+    }
+  }
+
+/*==========================================================================
+  scale_filtered
+  Scale using the weights in ax and ay, for the output rows y1 up to y2.
+  A band that starts part way down has to scale the source rows it
+  shares with the band above again, which is a row or two for each
+*==========================================================================*/
+static void scale_filtered (void *arg, int y1, int y2)
+  {
+  const ScaleJob *job = arg;
+  BitmapRGB *self = job->self;
+  const BitmapRGB *src = job->src;
+  int dx = job->dx, dy = job->dy, dw = job->dw;
+  const ScaleAxis *ax = job->ax, *ay = job->ay;
+  int x_lo = ax->start[0];
+  int x_hi = ax->start[dw - 1] + ax->ntaps[dw - 1] - 1;
+  v4f *pixels = aligned_alloc (sizeof (v4f),
+    (x_hi - x_lo + 1) * sizeof (v4f));
+
+  // Ring buffer of horizontally-scaled source rows. The rows needed
+  //   by any output row are consecutive, so no two can share a slot
+  int nring = ay->max_taps;
+  v4f *ring = aligned_alloc (sizeof (v4f), (size_t)nring * dw * sizeof (v4f));
+  int *ring_row = malloc (nring * sizeof (int));
+  for (int i = 0; i < nring; i++) ring_row[i] = -1;
+
+  for (int y = y1; y < y2; y++)
+    {
+    const v4f *rows[nring];
+    const float *w = ay->weights + y * ay->max_taps;
+    int n = ay->ntaps[y];
+    for (int j = 0; j < n; j++)
+      {
+      int r = ay->start[y] + j;
+      int slot = r % nring;
+      v4f *row = ring + (size_t)slot * dw;
+      if (ring_row[slot] != r)
+        {
+        scale_row (src->data + (size_t)r * src->w * BPP, x_lo, x_hi,
+          pixels, ax, dw, row);
+        ring_row[slot] = r;
+        }
+      rows[j] = row;
+      }
+
+    BYTE *out = self->data + ((size_t)(dy + y) * self->w + dx) * BPP;
+    for (int x = 0; x < dw; x++, out += BPP)
+      {
+      v4f acc = rows[0][x] * w[0];
+      for (int j = 1; j < n; j++)
+        acc += rows[j][x] * w[j];
+      v4b b = v4f_to_bytes (acc);
+      memcpy (out, &b, BPP);
+      }
+    }
+
+  free (ring_row);
+  free (ring);
+  free (pixels);
+  }
+
+/*==========================================================================
+  bitmaprgb_scale_into
+*==========================================================================*/
+void bitmaprgb_scale_into (BitmapRGB *self, const BitmapRGB *other,
+      BitmapRGBFilter filter, BitmapRGBScaleMode mode)
+  {
+  KLOG_IN
+  bitmaprgb_scale_into_tiled (self, other, filter, mode, NULL);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_scale_into_tiled
+*==========================================================================*/
+void bitmaprgb_scale_into_tiled (BitmapRGB *self, const BitmapRGB *other,
+      BitmapRGBFilter filter, BitmapRGBScaleMode mode, KThreadPool *pool)
+  {
+  KLOG_IN
+  // Work out the area of this bitmap to draw on, dx,dy,dw,dh, and the
+  //   area of the other to draw from, sx,sy,sw,sh
+  int dx = 0, dy = 0, dw = self->w, dh = self->h;
+  float sx = 0, sy = 0, sw = other->w, sh = other->h;
+  BOOL wider = (int64_t)other->w * self->h > (int64_t)other->h * self->w;
+  if (mode == BITMAPRGB_SCALE_FILL)
+    {
+    if (wider)
+      {
+      sw = (float)other->h * self->w / self->h;
+      sx = (other->w - sw) / 2;
+      }
+    else
+      {
+      sh = (float)other->w * self->h / self->w;
+      sy = (other->h - sh) / 2;
+      }
+    }
+  else
+    {
+    if (wider)
+      {
+      dh = (int)((int64_t)other->h * self->w / other->w);
+      if (dh < 1) dh = 1;
+      dy = (self->h - dh) / 2;
+      }
+    else
+      {
+      dw = (int)((int64_t)other->w * self->h / other->h);
+      if (dw < 1) dw = 1;
+      dx = (self->w - dw) / 2;
+      }
+    if (mode == BITMAPRGB_SCALE_LETTERBOX)
+      {
+      bitmaprgb_damage (self, 0, 0, self->w, self->h);
+      memset (self->data, 0, (size_t)self->w * dy * BPP);
+      memset (self->data + (size_t)self->w * (dy + dh) * BPP, 0,
+        (size_t)self->w * (self->h - dy - dh) * BPP);
+      for (int y = dy; y < dy + dh && dw < self->w; y++)
+        {
+        BYTE *row = self->data + (size_t)y * self->w * BPP;
+        memset (row, 0, (size_t)dx * BPP);
+        memset (row + (size_t)(dx + dw) * BPP, 0,
+          (size_t)(self->w - dx - dw) * BPP);
+        }
+      }
+    }
+
+  if (dw > 0 && dh > 0 && other->w > 0 && other->h > 0)
+    {
+    bitmaprgb_damage (self, dx, dy, dx + dw, dy + dh);
+    ScaleAxis ax, ay;
+    scale_axis_init (&ax, dw, sx, sw, other->w, filter);
+    scale_axis_init (&ay, dh, sy, sh, other->h, filter);
+    ScaleJob job = {self, other, dx, dy, dw, &ax, &ay};
+    // Each output row reads, on average, sh / dh source rows
+    size_t row_bytes = (size_t)dw * BPP
+      + (size_t)((float)other->w * BPP * sh / dh);
+    bitmaprgb_bands (pool, dh, row_bytes,
+      filter == BITMAPRGB_FILTER_BOX ? scale_box : scale_filtered, &job);
+    scale_axis_free (&ax);
+    scale_axis_free (&ay);
+    }
+  KLOG_OUT
+  }
+
@@ -0,0 +1,170 @@
+/*============================================================================
+
+  bitmaprgb_tone.c
+
+  Tone changes -- darkening, tinting, gamma and greyscale -- done in
+  place on a BitmapRGB, and the kernels that do them, which are also
+  used on the framebuffer.
+
+  Darkening and tinting are both multiplication of each channel by a
+  fraction, done in 16-bit fixed point with the vector types in
+  simd.h. 24 bytes -- eight 3-byte or six 4-byte pixels -- are done
+  at a time, so the pattern of per-channel factors is the same for
+  every block. Gamma is a table lookup, and greyscale is a weighted
+  sum of the channels, both in integer arithmetic.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/bitmaprgb.h>
+#include "bitmaprgb_private.h"
+#include "simd.h"
+#include "tone.h"
+
+#define KLOG_CLASS "klib.bitmaprgb_tone"
+
+// Bytes done in each pass of tone_scale(): a multiple of 3, 4 and 8
+#define SCALE_BLOCK 24
+
+/*==========================================================================
+  tone_scale
+*==========================================================================*/
+void tone_scale (BYTE *data, size_t n, int bpp, const BYTE factor[3])
+  {
+  v8s f[SCALE_BLOCK / 8];
+  for (int i = 0; i < SCALE_BLOCK; i++)
+    {
+    int c = i % bpp;
+    f[i / 8][i % 8] = c < 3 ? factor[c] : 255;
+    }
+
+  size_t len = n * bpp;
+  size_t i = 0;
+  for (; i + SCALE_BLOCK <= len; i += SCALE_BLOCK)
+    {
+    for (int j = 0; j < SCALE_BLOCK / 8; j++)
+      {
+      v8b b;
+      memcpy (&b, data + i + j * 8, 8);
+      v8s v = v8s_div255 (__builtin_convertvector (b, v8s) * f[j]);
+      b = __builtin_convertvector (v, v8b);
+      memcpy (data + i + j * 8, &b, 8);
+      }
+    }
+  // The remainder is less than a block, and starts on a pixel boundary
+  for (int c = 0; i < len; i++, c = (c + 1) % bpp)
+    {
+    if (c < 3) data[i] = (data[i] * factor[c] + 127) / 255;
+    }
+  }
+
+/*==========================================================================
+  tone_lut
+*==========================================================================*/
+void tone_lut (BYTE *data, size_t n, int bpp, const BYTE lut[256])
+  {
+  for (size_t i = 0; i < n; i++, data += bpp)
+    {
+    data[0] = lut[data[0]];
+    data[1] = lut[data[1]];
+    data[2] = lut[data[2]];
+    }
+  }
+
+/*==========================================================================
+  tone_grayscale
+  The weights are the ITU-R BT.601 luma coefficients, in 8-bit fixed
+  point
+*==========================================================================*/
+void tone_grayscale (BYTE *data, size_t n, int bpp)
+  {
+  for (size_t i = 0; i < n; i++, data += bpp)
+    {
+    BYTE y = (29 * data[0] + 150 * data[1] + 77 * data[2] + 128) >> 8;
+    data[0] = y;
+    data[1] = y;
+    data[2] = y;
+    }
+  }
+
+/*==========================================================================
+  tone_gamma_lut
+*==========================================================================*/
+void tone_gamma_lut (BYTE lut[256], float gamma)
+  {
+  if (gamma <= 0) gamma = 1;
+  for (int i = 0; i < 256; i++)
+    lut[i] = (BYTE)(255.0f * powf (i / 255.0f, gamma) + 0.5f);
+  }
+
+/*==========================================================================
+  tone_darken_factor
+*==========================================================================*/
+void tone_darken_factor (BYTE factor[3], int percent)
+  {
+  if (percent < 0) percent = 0;
+  if (percent > 100) percent = 100;
+  factor[0] = factor[1] = factor[2] = (percent * 255 + 50) / 100;
+  }
+
+/*==========================================================================
+
+  bitmaprgb_darken
+
+  Darken to the specified percentage of original value
+
+*==========================================================================*/
+void bitmaprgb_darken (BitmapRGB *self, int percent)
+  {
+  KLOG_IN
+  BYTE factor[3];
+  tone_darken_factor (factor, percent);
+  tone_scale (self->data, (size_t)self->w * self->h, BPP, factor);
+  bitmaprgb_damage (self, 0, 0, self->w, self->h);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_tint
+*==========================================================================*/
+void bitmaprgb_tint (BitmapRGB *self, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  BYTE factor[3] = {b, g, r};
+  tone_scale (self->data, (size_t)self->w * self->h, BPP, factor);
+  bitmaprgb_damage (self, 0, 0, self->w, self->h);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_gamma
+*==========================================================================*/
+void bitmaprgb_gamma (BitmapRGB *self, float gamma)
+  {
+  KLOG_IN
+  BYTE lut[256];
+  tone_gamma_lut (lut, gamma);
+  tone_lut (self->data, (size_t)self->w * self->h, BPP, lut);
+  bitmaprgb_damage (self, 0, 0, self->w, self->h);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgb_grayscale
+*==========================================================================*/
+void bitmaprgb_grayscale (BitmapRGB *self)
+  {
+  KLOG_IN
+  tone_grayscale (self->data, (size_t)self->w * self->h, BPP);
+  bitmaprgb_damage (self, 0, 0, self->w, self->h);
+  KLOG_OUT
+  }
+
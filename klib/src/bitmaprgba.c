@@ -0,0 +1,313 @@
+/*============================================================================
+
+  bitmaprgba.c
+
+  Laying one pixel over another with premultiplied alpha is just
+
+    out = src + dst * (255 - src_alpha) / 255
+
+  for each channel, which is done in 16-bit fixed point on two pixels
+  at a time, using the vector types in simd.h. Pairs of pixels that
+  are fully transparent are not written at all, and those that are
+  fully opaque are just copied, so an overlay that is mostly empty, or
+  mostly solid, costs little more than the area it covers.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/framebuffer.h>
+#include <klib/bitmaprgb.h>
+#include <klib/bitmaprgba.h>
+#include "bitmaprgb_private.h"
+#include "simd.h"
+#include "fb_format.h"
+
+#define KLOG_CLASS "klib.bitmaprgba"
+
+struct _BitmapRGBA
+  {
+  int w;
+  int h;
+  BYTE *data; // h rows of w pixels, each stored as b,g,r,a
+  };
+
+/*==========================================================================
+  bitmaprgba_create
+*==========================================================================*/
+BitmapRGBA *bitmaprgba_create (int w, int h)
+  {
+  KLOG_IN
+  BitmapRGBA *self = malloc (sizeof (BitmapRGBA));
+  self->w = w;
+  self->h = h;
+  self->data = calloc ((size_t)w * h, 4);
+  KLOG_OUT
+  return self;
+  }
+
+/*==========================================================================
+  bitmaprgba_destroy
+*==========================================================================*/
+void bitmaprgba_destroy (BitmapRGBA *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    free (self->data);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgba_get_width
+*==========================================================================*/
+int bitmaprgba_get_width (const BitmapRGBA *self)
+  {
+  return self->w;
+  }
+
+/*==========================================================================
+  bitmaprgba_get_height
+*==========================================================================*/
+int bitmaprgba_get_height (const BitmapRGBA *self)
+  {
+  return self->h;
+  }
+
+/*==========================================================================
+  bitmaprgba_get_data
+*==========================================================================*/
+BYTE *bitmaprgba_get_data (BitmapRGBA *self)
+  {
+  return self->data;
+  }
+
+/*==========================================================================
+  bitmaprgba_clear
+*==========================================================================*/
+void bitmaprgba_clear (BitmapRGBA *self)
+  {
+  memset (self->data, 0, (size_t)self->w * self->h * 4);
+  }
+
+/*==========================================================================
+  bitmaprgba_premultiply
+  Make the stored form of the colour r,g,b with alpha a
+*==========================================================================*/
+static void bitmaprgba_premultiply (BYTE *p, BYTE r, BYTE g, BYTE b, BYTE a)
+  {
+  p[0] = (b * a + 127) / 255;
+  p[1] = (g * a + 127) / 255;
+  p[2] = (r * a + 127) / 255;
+  p[3] = a;
+  }
+
+/*==========================================================================
+  bitmaprgba_set_pixel
+*==========================================================================*/
+void bitmaprgba_set_pixel (BitmapRGBA *self, int x, int y,
+      BYTE r, BYTE g, BYTE b, BYTE a)
+  {
+  if (x >= 0 && x < self->w && y >= 0 && y < self->h)
+    bitmaprgba_premultiply (self->data + ((size_t)y * self->w + x) * 4,
+      r, g, b, a);
+  }
+
+/*==========================================================================
+  bitmaprgba_fill_rect
+  x2,y2 point is _excluded_
+*==========================================================================*/
+void bitmaprgba_fill_rect (BitmapRGBA *self, int x1, int y1,
+      int x2, int y2, BYTE r, BYTE g, BYTE b, BYTE a)
+  {
+  KLOG_IN
+  if (x1 < 0) x1 = 0;
+  if (y1 < 0) y1 = 0;
+  if (x2 > self->w) x2 = self->w;
+  if (y2 > self->h) y2 = self->h;
+  BYTE pixel[4];
+  bitmaprgba_premultiply (pixel, r, g, b, a);
+  for (int y = y1; y < y2; y++)
+    {
+    BYTE *p = self->data + ((size_t)y * self->w + x1) * 4;
+    for (int x = x1; x < x2; x++, p += 4)
+      memcpy (p, pixel, 4);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgba_blend
+  Lay the two pixels in s over the two in d. Each pixel is four
+  elements, b,g,r,a, of which the a of d can be anything
+*==========================================================================*/
+static inline v8s bitmaprgba_blend (v8s s, v8s d)
+  {
+  v8s a = __builtin_shuffle (s, (v8s){3, 3, 3, 3, 7, 7, 7, 7});
+  return s + v8s_div255 (d * (255 - a));
+  }
+
+/*==========================================================================
+  bitmaprgba_load_pair
+  Load n (1 or 2) pixels of src
+*==========================================================================*/
+static inline v8s bitmaprgba_load_pair (const BYTE *src, int n)
+  {
+  v8b b = {0};
+  memcpy (&b, src, n * 4);
+  return __builtin_convertvector (b, v8s);
+  }
+
+/*==========================================================================
+  bitmaprgba_over_row
+  Lay n pixels of src over n pixels of dst, which are bpp (3 or 4)
+  bytes each, and start with b,g,r
+*==========================================================================*/
+static void bitmaprgba_over_row (const BYTE *src, BYTE *dst, int n,
+      int bpp)
+  {
+  for (int x = 0; x < n; x += 2, src += 8, dst += 2 * bpp)
+    {
+    int np = n - x < 2 ? 1 : 2;
+    BYTE a0 = src[3], a1 = np == 2 ? src[7] : a0;
+    if ((a0 | a1) == 0) continue;
+    if ((a0 & a1) == 255)
+      {
+      for (int i = 0; i < np; i++)
+        memcpy (dst + i * bpp, src + i * 4, 3);
+      continue;
+      }
+
+    v8s s = bitmaprgba_load_pair (src, np);
+    v8s d = {dst[0], dst[1], dst[2], 0};
+    if (np == 2)
+      {
+      d[4] = dst[bpp];
+      d[5] = dst[bpp + 1];
+      d[6] = dst[bpp + 2];
+      }
+    v8b out = __builtin_convertvector (bitmaprgba_blend (s, d), v8b);
+    for (int i = 0; i < np; i++)
+      memcpy (dst + i * bpp, (BYTE *)&out + i * 4, 3);
+    }
+  }
+
+/*==========================================================================
+  bitmaprgba_clip
+  Work out which part of self falls on a w x h destination, when drawn
+  with its top-left corner at x,y. Returns FALSE if none does
+*==========================================================================*/
+static BOOL bitmaprgba_clip (const BitmapRGBA *self, int dest_w, int dest_h,
+      int *x, int *y, int *sx, int *sy, int *w, int *h)
+  {
+  *sx = 0; *sy = 0;
+  *w = self->w; *h = self->h;
+  if (*x < 0) { *sx = -*x; *w += *x; *x = 0; }
+  if (*y < 0) { *sy = -*y; *h += *y; *y = 0; }
+  if (*x + *w > dest_w) *w = dest_w - *x;
+  if (*y + *h > dest_h) *h = dest_h - *y;
+  return *w > 0 && *h > 0;
+  }
+
+// The arguments of bitmaprgba_over_tiled(), after clipping
+typedef struct _OverJob
+  {
+  const BitmapRGBA *self;
+  BitmapRGB *dest;
+  int x, y, sx, sy, w;
+  } OverJob;
+
+/*==========================================================================
+  bitmaprgba_over_band
+  Lay the rows y1 up to y2 of the clipped rectangle of an OverJob
+*==========================================================================*/
+static void bitmaprgba_over_band (void *arg, int y1, int y2)
+  {
+  const OverJob *job = arg;
+  for (int row = y1; row < y2; row++)
+    {
+    bitmaprgba_over_row
+      (job->self->data + ((size_t)(job->sy + row) * job->self->w
+        + job->sx) * 4,
+      job->dest->data + ((size_t)(job->y + row) * job->dest->w + job->x)
+        * BPP, job->w, BPP);
+    }
+  }
+
+/*==========================================================================
+  bitmaprgba_over
+*==========================================================================*/
+void bitmaprgba_over (const BitmapRGBA *self, BitmapRGB *dest, int x, int y)
+  {
+  KLOG_IN
+  bitmaprgba_over_tiled (self, dest, x, y, NULL);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgba_over_tiled
+*==========================================================================*/
+void bitmaprgba_over_tiled (const BitmapRGBA *self, BitmapRGB *dest,
+      int x, int y, KThreadPool *pool)
+  {
+  KLOG_IN
+  OverJob job;
+  int h;
+  if (bitmaprgba_clip (self, dest->w, dest->h, &x, &y, &job.sx, &job.sy,
+        &job.w, &h))
+    {
+    bitmaprgb_damage (dest, x, y, x + job.w, y + h);
+    job.self = self;
+    job.dest = dest;
+    job.x = x;
+    job.y = y;
+    bitmaprgb_bands (pool, h, (size_t)job.w * (4 + BPP),
+      bitmaprgba_over_band, &job);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  bitmaprgba_over_fb
+  Pixels of 3 or 4 bytes are blended in place; RGB565 ones are widened
+  to b,g,r a row at a time, and packed again afterwards
+*==========================================================================*/
+void bitmaprgba_over_fb (const BitmapRGBA *self, FrameBuffer *fb,
+      int x, int y)
+  {
+  KLOG_IN
+  BYTE *data = framebuffer_get_data (fb);
+  int w_out = framebuffer_get_width (fb);
+  int h_out = framebuffer_get_height (fb);
+  int bytes_pp = framebuffer_get_bits_per_pixel (fb) / 8;
+  size_t stride = framebuffer_get_stride (fb);
+  int sx, sy, w, h;
+  if (bitmaprgba_clip (self, w_out, h_out, &x, &y, &sx, &sy, &w, &h))
+    {
+    BYTE *bgr = bytes_pp < 3 ? malloc ((size_t)w * 3) : NULL;
+    for (int row = 0; row < h; row++)
+      {
+      const BYTE *src = self->data + ((size_t)(sy + row) * self->w + sx) * 4;
+      BYTE *dst = data + (y + row) * stride + (size_t)x * bytes_pp;
+      if (bgr)
+        {
+        fb_format_to_bgr (dst, bytes_pp, bgr, w);
+        bitmaprgba_over_row (src, bgr, w, 3);
+        fb_format_from_bgr (bgr, dst, bytes_pp, w);
+        }
+      else
+        bitmaprgba_over_row (src, dst, w, bytes_pp);
+      }
+    free (bgr);
+    }
+  KLOG_OUT
+  }
+
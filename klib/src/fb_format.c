@@ -0,0 +1,64 @@
+/*============================================================================
+
+  fb_format.c
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#include <string.h>
+#include <stdint.h>
+#include <klib/defs.h>
+#include "fb_format.h"
+
+/*==========================================================================
+  fb_format_to_bgr
+  RGB565 is widened by repeating the top bits in the bottom ones, so 
+  that full intensity stays full intensity
+*==========================================================================*/
+void fb_format_to_bgr (const BYTE *in, int bytes_pp, BYTE *out, int n)
+  {
+  if (bytes_pp == 3)
+    {
+    memcpy (out, in, (size_t)n * 3);
+    return;
+    }
+  for (int i = 0; i < n; i++, in += bytes_pp, out += 3)
+    {
+    if (bytes_pp == 2)
+      {
+      int v = in[0] | (in[1] << 8);
+      int r = v >> 11, g = (v >> 5) & 0x3F, b = v & 0x1F;
+      out[0] = (b << 3) | (b >> 2);
+      out[1] = (g << 2) | (g >> 4);
+      out[2] = (r << 3) | (r >> 2);
+      }
+    else
+      memcpy (out, in, 3);
+    }
+  }
+
+/*==========================================================================
+  fb_format_from_bgr
+  A fourth byte, if there is one, is left alone
+*==========================================================================*/
+void fb_format_from_bgr (const BYTE *in, BYTE *out, int bytes_pp, int n)
+  {
+  if (bytes_pp == 3)
+    {
+    memcpy (out, in, (size_t)n * 3);
+    return;
+    }
+  for (int i = 0; i < n; i++, in += 3, out += bytes_pp)
+    {
+    if (bytes_pp == 2)
+      {
+      int v = ((in[2] >> 3) << 11) | ((in[1] >> 2) << 5) | (in[0] >> 3);
+      out[0] = v;
+      out[1] = v >> 8;
+      }
+    else
+      memcpy (out, in, 3);
+    }
+  }
+
@@ -0,0 +1,28 @@
+/*============================================================================
+
+  fb_format.h
+
+  Conversion of runs of pixels between the BitmapRGB format (three
+  bytes, b,g,r) and the framebuffer formats: 4 bytes (b,g,r,unused), 3
+  bytes (b,g,r), and 2 bytes (RGB565, little-endian). Conversion to
+  RGB565 just drops the low bits; see bitmaprgb_dither.c for better.
+  This header is private to klib.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <klib/defs.h>
+#include <klib/types.h>
+
+BEGIN_DECLS
+
+/** Convert n pixels of bytes_pp bytes each, at in, to b,g,r at out. */
+void fb_format_to_bgr (const BYTE *in, int bytes_pp, BYTE *out, int n);
+/** Convert n b,g,r pixels at in, to bytes_pp bytes each at out. */
+void fb_format_from_bgr (const BYTE *in, BYTE *out, int bytes_pp, int n);
+
+END_DECLS
+
@@ -4,9 +4,10 @@
 
   Implementation of the "methods" defined in framebuffer.h. 
 
-  Note that this implementation assumes a linear, 32-bpp framebuffer. 
-  While this is a common framebuffer layout, it is by no means
-  ubiquitous. The implementation allows for the fact that there can be
+  Note that this implementation assumes a linear framebuffer of 16
+  (RGB565), 24, or 32 bits per pixel. While these are the common
+  framebuffer layouts, they are by no means ubiquitous. The 
+  implementation allows for the fact that there can be
   "slop" at the end of a block of memory locations that doesn't map
   to pixels. However, it doesn't allow for non-sequential row ordering,
   or palette mapping, or any of that stuff.
@@ -37,6 +38,8 @@
 #include <klib/defs.h> 
 #include <klib/klog.h> 
 #include <klib/framebuffer.h>
+#include "tone.h"
+#include "fb_format.h"
 
 #define KLOG_CLASS "klib.framebuffer"
 
@@ -50,7 +53,7 @@ struct _FrameBuffer
   int fb_data_size; // Total amount of mapped memory
   BYTE *fb_data; // Pointer to the mapped memory
   char *fbdev; // Original device name
-  int fb_bytes; // Number of bytes per pixel -- must by 3 or 4
+  int fb_bytes; // Number of bytes per pixel -- 2, 3 or 4
   int line_length; // Number of pixels in a line, as reported by the device
   int stride; // Bytes between vertically-adjacent rows of pixels
   int slop; // Amount of line_length that does not correspond to pixels.
@@ -100,9 +103,11 @@ BOOL framebuffer_init (FrameBuffer *self, char **error)
     int fb_bpp = vinfo.bits_per_pixel;
     int fb_bytes = fb_bpp / 8;
     self->fb_bytes = fb_bytes;
-    self->fb_data_size = self->w * self->h * fb_bytes;
     self->stride = max (self->line_length, self->w * self->fb_bytes);
     self->slop = self->stride - (self->w * self->fb_bytes);
+    // Map whole rows, including the slop, or framebuffer_clear() and
+    //   the last rows of pixels would run off the end of the mapping
+    self->fb_data_size = self->stride * self->h;
 
     self->fb_data = mmap (0, self->fb_data_size, 
 	     PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, (off_t)0);
@@ -128,6 +133,91 @@ void framebuffer_clear (FrameBuffer *self)
   memset (self->fb_data, 0, self->stride * self->h);
   }
 
+// The tone changes that framebuffer_tone() can make
+typedef enum
+  {
+  FB_TONE_SCALE,
+  FB_TONE_LUT,
+  FB_TONE_GRAYSCALE
+  } FrameBufferTone;
+
+/*==========================================================================
+  framebuffer_tone
+  Run a tone kernel on each row of pixels in turn, skipping the slop.
+  RGB565 rows are widened to b,g,r and back, since the kernels work on
+  whole bytes
+*==========================================================================*/
+static void framebuffer_tone (FrameBuffer *self, FrameBufferTone tone,
+      const BYTE *arg)
+  {
+  BYTE *bgr = self->fb_bytes == 2 ? malloc ((size_t)self->w * 3) : NULL;
+  for (int y = 0; y < self->h; y++)
+    {
+    BYTE *row = self->fb_data + (size_t)y * self->stride;
+    BYTE *p = row;
+    int bpp = self->fb_bytes;
+    if (bgr)
+      {
+      fb_format_to_bgr (row, bpp, bgr, self->w);
+      p = bgr;
+      bpp = 3;
+      }
+    switch (tone)
+      {
+      case FB_TONE_SCALE: tone_scale (p, self->w, bpp, arg); break;
+      case FB_TONE_LUT: tone_lut (p, self->w, bpp, arg); break;
+      case FB_TONE_GRAYSCALE: tone_grayscale (p, self->w, bpp); break;
+      }
+    if (bgr) fb_format_from_bgr (bgr, row, self->fb_bytes, self->w);
+    }
+  free (bgr);
+  }
+
+/*==========================================================================
+  framebuffer_darken
+*==========================================================================*/
+void framebuffer_darken (FrameBuffer *self, int percent)
+  {
+  KLOG_IN
+  BYTE factor[3];
+  tone_darken_factor (factor, percent);
+  framebuffer_tone (self, FB_TONE_SCALE, factor);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  framebuffer_tint
+*==========================================================================*/
+void framebuffer_tint (FrameBuffer *self, BYTE r, BYTE g, BYTE b)
+  {
+  KLOG_IN
+  BYTE factor[3] = {b, g, r};
+  framebuffer_tone (self, FB_TONE_SCALE, factor);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  framebuffer_gamma
+*==========================================================================*/
+void framebuffer_gamma (FrameBuffer *self, float gamma)
+  {
+  KLOG_IN
+  BYTE lut[256];
+  tone_gamma_lut (lut, gamma);
+  framebuffer_tone (self, FB_TONE_LUT, lut);
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  framebuffer_grayscale
+*==========================================================================*/
+void framebuffer_grayscale (FrameBuffer *self)
+  {
+  KLOG_IN
+  framebuffer_tone (self, FB_TONE_GRAYSCALE, NULL);
+  KLOG_OUT
+  }
+
 /*==========================================================================
   framebuffer_deinit
 *==========================================================================*/
@@ -157,13 +247,11 @@ void framebuffer_deinit (FrameBuffer *self)
 void framebuffer_set_pixel (FrameBuffer *self, int x, int y, 
       BYTE r, BYTE g, BYTE b)
   {
-  if (x > 0 && x < self->w && y > 0 && y < self->h)
+  if (x >= 0 && x < self->w && y >= 0 && y < self->h)
     {
-    int index32 = (y * self->w + x) * self->fb_bytes + y * self->slop;
-    self->fb_data [index32++] = b;
-    self->fb_data [index32++] = g;
-    self->fb_data [index32++] = r;
-    self->fb_data [index32] = 0;
+    BYTE bgr[3] = {b, g, r};
+    fb_format_from_bgr (bgr, self->fb_data + y * self->stride
+      + x * self->fb_bytes, self->fb_bytes, 1);
     }
   }
 
@@ -198,18 +286,36 @@ int framebuffer_get_height (const FrameBuffer *self)
   return self->h;
   }
 
+/*==========================================================================
+  framebuffer_get_bits_per_pixel
+*==========================================================================*/
+int framebuffer_get_bits_per_pixel (const FrameBuffer *self)
+  {
+  return self->fb_bytes * 8;
+  }
+
+/*==========================================================================
+  framebuffer_get_stride
+*==========================================================================*/
+int framebuffer_get_stride (const FrameBuffer *self)
+  {
+  return self->stride;
+  }
+
 /*==========================================================================
   framebuffer_get_pixel
 *==========================================================================*/
 void framebuffer_get_pixel (const FrameBuffer *self, 
                       int x, int y, BYTE *r, BYTE *g, BYTE *b)
   {
-  if (x > 0 && x < self->w && y > 0 && y < self->h)
+  if (x >= 0 && x < self->w && y >= 0 && y < self->h)
     {
-    int index32 = (y * self->w + x) * self->fb_bytes + (y * self->slop);
-    *b = self->fb_data [index32++];
-    *g = self->fb_data [index32++];
-    *r = self->fb_data [index32];
+    BYTE bgr[3];
+    fb_format_to_bgr (self->fb_data + y * self->stride 
+      + x * self->fb_bytes, self->fb_bytes, bgr, 1);
+    *b = bgr[0];
+    *g = bgr[1];
+    *r = bgr[2];
     }
   else
     {
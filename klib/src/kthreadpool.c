@@ -0,0 +1,282 @@
+/*============================================================================
+
+  kthreadpool.c
+
+  Each thread has a queue, which is just a range of task numbers. A
+  job is dealt out as equal ranges, and each thread takes tasks from
+  the front of its own. One whose range is empty looks at the others
+  in turn, and takes the back half of the first that has anything
+  left, so a thread that is held up -- by a slow task, or by not
+  being scheduled -- has its work shared out among the rest. There
+  are only ever a few dozen tasks in a job, so each queue simply has
+  its own mutex.
+
+  The workers wait for a new job on a condition variable, and the
+  thread that started it waits, once it has no more tasks of its own
+  to do or steal, until every worker has finished with it.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <klib/defs.h>
+#include <klib/klog.h>
+#include <klib/kthreadpool.h>
+
+#define KLOG_CLASS "klib.kthreadpool"
+
+// The tasks from next up to, but not including, end
+typedef struct _KThreadPoolQueue
+  {
+  pthread_mutex_t mutex;
+  int next;
+  int end;
+  } KThreadPoolQueue;
+
+struct _KThreadPool;
+
+typedef struct _KThreadPoolWorker
+  {
+  struct _KThreadPool *pool;
+  int index; // Of its queue. The thread that runs the job has queue 0
+  pthread_t thread;
+  } KThreadPoolWorker;
+
+struct _KThreadPool
+  {
+  int threads;
+  KThreadPoolQueue *queues; // One for each thread
+  KThreadPoolWorker *workers; // threads - 1 of them
+  pthread_mutex_t run_mutex; // Held for the whole of a job
+  pthread_mutex_t mutex; // Protects everything below
+  pthread_cond_t start;
+  pthread_cond_t finished;
+  unsigned int job; // Counts jobs, so workers can tell a new one
+  int busy; // Workers that have not yet finished the current job
+  BOOL quit;
+  KThreadPoolTask task;
+  void *arg;
+  };
+
+/*==========================================================================
+  kthreadpool_take
+  Take a task from the front of queue q, returning -1 if it is empty
+*==========================================================================*/
+static int kthreadpool_take (KThreadPoolQueue *q)
+  {
+  int index = -1;
+  pthread_mutex_lock (&q->mutex);
+  if (q->next < q->end) index = q->next++;
+  pthread_mutex_unlock (&q->mutex);
+  return index;
+  }
+
+/*==========================================================================
+  kthreadpool_steal
+  Take the back half of the first other queue that has anything in
+  it, returning the first of the tasks taken and putting the rest in
+  the queue of thread self; or -1 if all are empty
+*==========================================================================*/
+static int kthreadpool_steal (KThreadPool *pool, int self)
+  {
+  for (int i = 1; i < pool->threads; i++)
+    {
+    KThreadPoolQueue *victim = &pool->queues[(self + i) % pool->threads];
+    int first = -1, end = 0;
+    pthread_mutex_lock (&victim->mutex);
+    if (victim->next < victim->end)
+      {
+      first = victim->next + (victim->end - victim->next) / 2;
+      end = victim->end;
+      victim->end = first;
+      }
+    pthread_mutex_unlock (&victim->mutex);
+    if (first >= 0)
+      {
+      KThreadPoolQueue *q = &pool->queues[self];
+      pthread_mutex_lock (&q->mutex);
+      q->next = first + 1;
+      q->end = end;
+      pthread_mutex_unlock (&q->mutex);
+      return first;
+      }
+    }
+  return -1;
+  }
+
+/*==========================================================================
+  kthreadpool_work
+  Do tasks of the current job, as thread self, until there are none
+  left to take
+*==========================================================================*/
+static void kthreadpool_work (KThreadPool *pool, int self)
+  {
+  for (;;)
+    {
+    int index = kthreadpool_take (&pool->queues[self]);
+    if (index < 0) index = kthreadpool_steal (pool, self);
+    if (index < 0) break;
+    pool->task (pool->arg, index);
+    }
+  }
+
+/*==========================================================================
+  kthreadpool_thread
+*==========================================================================*/
+static void *kthreadpool_thread (void *arg)
+  {
+  KThreadPoolWorker *worker = arg;
+  KThreadPool *pool = worker->pool;
+  // No job can have started before the pool was created
+  unsigned int done = 0;
+  pthread_mutex_lock (&pool->mutex);
+  for (;;)
+    {
+    while (pool->job == done && !pool->quit)
+      pthread_cond_wait (&pool->start, &pool->mutex);
+    if (pool->quit) break;
+    done = pool->job;
+    pthread_mutex_unlock (&pool->mutex);
+
+    kthreadpool_work (pool, worker->index);
+
+    pthread_mutex_lock (&pool->mutex);
+    if (--pool->busy == 0)
+      pthread_cond_signal (&pool->finished);
+    }
+  pthread_mutex_unlock (&pool->mutex);
+  return NULL;
+  }
+
+/*==========================================================================
+  kthreadpool_create
+*==========================================================================*/
+KThreadPool *kthreadpool_create (int threads)
+  {
+  KLOG_IN
+  if (threads <= 0)
+    {
+    long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int)cpus : 1;
+    }
+  KThreadPool *self = malloc (sizeof (KThreadPool));
+  self->queues = malloc (threads * sizeof (KThreadPoolQueue));
+  for (int i = 0; i < threads; i++)
+    {
+    pthread_mutex_init (&self->queues[i].mutex, NULL);
+    self->queues[i].next = 0;
+    self->queues[i].end = 0;
+    }
+  self->workers = malloc (threads * sizeof (KThreadPoolWorker));
+  pthread_mutex_init (&self->run_mutex, NULL);
+  pthread_mutex_init (&self->mutex, NULL);
+  pthread_cond_init (&self->start, NULL);
+  pthread_cond_init (&self->finished, NULL);
+  self->job = 0;
+  self->busy = 0;
+  self->quit = FALSE;
+  self->task = NULL;
+  self->arg = NULL;
+
+  self->threads = 1;
+  for (int i = 1; i < threads; i++)
+    {
+    KThreadPoolWorker *worker = &self->workers[i - 1];
+    worker->pool = self;
+    worker->index = i;
+    int err = pthread_create (&worker->thread, NULL, kthreadpool_thread,
+      worker);
+    if (err != 0)
+      {
+      klog_warn (KLOG_CLASS, "Can't start thread: %s", strerror (err));
+      break;
+      }
+    self->threads++;
+    }
+  klog_debug (KLOG_CLASS, "Thread pool has %d threads", self->threads);
+  KLOG_OUT
+  return self;
+  }
+
+/*==========================================================================
+  kthreadpool_destroy
+*==========================================================================*/
+void kthreadpool_destroy (KThreadPool *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    pthread_mutex_lock (&self->mutex);
+    self->quit = TRUE;
+    pthread_cond_broadcast (&self->start);
+    pthread_mutex_unlock (&self->mutex);
+    for (int i = 0; i < self->threads - 1; i++)
+      pthread_join (self->workers[i].thread, NULL);
+
+    for (int i = 0; i < self->threads; i++)
+      pthread_mutex_destroy (&self->queues[i].mutex);
+    pthread_mutex_destroy (&self->run_mutex);
+    pthread_mutex_destroy (&self->mutex);
+    pthread_cond_destroy (&self->start);
+    pthread_cond_destroy (&self->finished);
+    free (self->queues);
+    free (self->workers);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*==========================================================================
+  kthreadpool_get_threads
+*==========================================================================*/
+int kthreadpool_get_threads (const KThreadPool *self)
+  {
+  return self ? self->threads : 1;
+  }
+
+/*==========================================================================
+  kthreadpool_run
+*==========================================================================*/
+void kthreadpool_run (KThreadPool *self, int n, KThreadPoolTask task,
+      void *arg)
+  {
+  if (!self || self->threads == 1 || n <= 1)
+    {
+    for (int i = 0; i < n; i++)
+      task (arg, i);
+    return;
+    }
+
+  pthread_mutex_lock (&self->run_mutex);
+  pthread_mutex_lock (&self->mutex);
+  self->task = task;
+  self->arg = arg;
+  for (int i = 0; i < self->threads; i++)
+    {
+    KThreadPoolQueue *q = &self->queues[i];
+    pthread_mutex_lock (&q->mutex);
+    q->next = (int)((int64_t)n * i / self->threads);
+    q->end = (int)((int64_t)n * (i + 1) / self->threads);
+    pthread_mutex_unlock (&q->mutex);
+    }
+  self->busy = self->threads - 1;
+  self->job++;
+  pthread_cond_broadcast (&self->start);
+  pthread_mutex_unlock (&self->mutex);
+
+  kthreadpool_work (self, 0);
+
+  pthread_mutex_lock (&self->mutex);
+  while (self->busy > 0)
+    pthread_cond_wait (&self->finished, &self->mutex);
+  pthread_mutex_unlock (&self->mutex);
+  pthread_mutex_unlock (&self->run_mutex);
+  }
+
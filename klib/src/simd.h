@@ -0,0 +1,75 @@
+/*============================================================================
+
+  simd.h
+
+  Types and helpers for writing SIMD code using the gcc vector
+  extensions. gcc turns operations on these types into whatever vector
+  instructions the target has -- SSE2 on x86-64, NEON on ARM -- or
+  into ordinary instructions where it has none, so no architecture-
+  specific code or compiler flags are needed. Vectors are 128 bits,
+  which is the natural size on all the targets we care about.
+
+  This header is private to klib.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+typedef float v4f __attribute__ ((vector_size (16)));
+typedef int32_t v4i __attribute__ ((vector_size (16)));
+typedef uint8_t v4b __attribute__ ((vector_size (4)));
+typedef uint16_t v8s __attribute__ ((vector_size (16)));
+typedef uint8_t v8b __attribute__ ((vector_size (8)));
+
+/*==========================================================================
+  v4i_clamp_byte
+  Limit each element to the range 0-255
+*==========================================================================*/
+static inline v4i v4i_clamp_byte (v4i v)
+  {
+  v4i m = v < 0;
+  v &= ~m;
+  m = v > 255;
+  return (v & ~m) | (255 & m);
+  }
+
+/*==========================================================================
+  v4f_load_bytes
+  Load four bytes from memory as floats
+*==========================================================================*/
+static inline v4f v4f_load_bytes (const uint8_t *p)
+  {
+  v4b b;
+  memcpy (&b, p, sizeof (b));
+  return __builtin_convertvector (b, v4f);
+  }
+
+/*==========================================================================
+  v4f_to_bytes
+  Round each element to the nearest whole number, limited to 0-255
+*==========================================================================*/
+static inline v4b v4f_to_bytes (v4f v)
+  {
+  // Conversion truncates towards zero, which is only wrong for values
+  //   that are clamped to zero anyway
+  v4i i = __builtin_convertvector (v + 0.5f, v4i);
+  return __builtin_convertvector (v4i_clamp_byte (i), v4b);
+  }
+
+/*==========================================================================
+  v8s_div255
+  Divide each element, which must be no more than 255 * 255, by 255,
+  rounding to the nearest whole number. This is exact, and needs no
+  division
+*==========================================================================*/
+static inline v8s v8s_div255 (v8s v)
+  {
+  v += 128;
+  return (v + (v >> 8)) >> 8;
+  }
+
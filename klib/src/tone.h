@@ -0,0 +1,34 @@
+/*============================================================================
+
+  tone.h
+
+  Kernels that change the tone of a run of pixels in place, shared by
+  the BitmapRGB and FrameBuffer tone functions. Each pixel is bpp (3 or
+  4) bytes, starting b,g,r; any fourth byte is left alone. This header
+  is private to klib.
+
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <klib/defs.h>
+
+BEGIN_DECLS
+
+/** Multiply each channel by factor/255, where factor is b,g,r. */
+void tone_scale (BYTE *data, size_t n, int bpp, const BYTE factor[3]);
+/** Replace each channel value v by lut[v]. */
+void tone_lut (BYTE *data, size_t n, int bpp, const BYTE lut[256]);
+/** Replace each pixel by a grey of the same brightness. */
+void tone_grayscale (BYTE *data, size_t n, int bpp);
+/** Fill lut with the gamma correction table for gamma. */
+void tone_gamma_lut (BYTE lut[256], float gamma);
+/** Fill factor with the tone_scale() factors for darkening to percent
+    of the original brightness. */
+void tone_darken_factor (BYTE factor[3], int percent);
+
+END_DECLS
+
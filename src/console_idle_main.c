@@ -8,6 +8,7 @@
   GNU Public Licence, v3.0
 
   ==========================================================================*/
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> 
@@ -22,16 +23,58 @@
 #include <signal.h> 
 #include <pwd.h> 
 #include <linux/kd.h> 
+#include <sched.h> 
 #include <sys/ioctl.h> 
+#include <sys/resource.h> 
 #include <klib/klib.h> 
+#include "monotime.h" 
+#include "saver_process.h" 
+#include "saver_playlist.h" 
+#include "saver_snapshot.h" 
+#include "saver_engine.h" 
 
 #define KLOG_CLASS "console_idle.main"
 
 #define MAX_DEVS 32
 #define DEFAULT_TIMEOUT 120
 #define DEFAULT_FBDEV "/dev/fb0" 
+#define DEFAULT_GRACE 5
+#define DEFAULT_MAX_RESTARTS 5
+// Delay before restarting a failed screen-saver, which doubles with 
+//   each consecutive failure, up to a limit
+#define RESTART_MIN_MS 1000
+#define RESTART_MAX_MS 60000
+// A screen-saver that exits after running at least this long is
+//   not considered to be failing repeatedly
+#define STABLE_RUN_MS 60000
+// Number of pollfd slots after the input devices: the shutdown pipe,
+//   the screen-saver process, and its notification pipe
+#define NEXTRA_FDS 3
+
+// Codes for options that have no short form
+enum
+  {
+  OPT_SAVER_CGROUP = 256,
+  OPT_SAVER_CPU_MAX,
+  OPT_SAVER_MEMORY_MAX,
+  OPT_SAVER_IO_MAX,
+  OPT_SAVER_NICE,
+  OPT_SAVER_SCHED,
+  OPT_SAVER_CPUS,
+  OPT_DAEMON_NICE,
+  OPT_SAVER,
+  OPT_PLAYLIST,
+  OPT_ROTATE,
+  OPT_MAX_RESTARTS,
+  OPT_FB_ROTATE,
+  OPT_FB_DITHER,
+  OPT_FB_THREADS
+  };
 
 BOOL stop = FALSE;
+// Written by the signal handler, so that a shutdown signal always 
+//   wakes up poll()
+int stop_pipe[2] = { -1, -1 };
 
 typedef struct _LogContext
   {
@@ -81,13 +124,30 @@ void console_idle_log_handler (KLogLevel level, const char *cls,
   ==========================================================================*/
 void console_idle_show_usage (const char *argv0, FILE *f) 
   {
-  fprintf (f, "Usage: %s [options] -- command args...\n", argv0);
+  fprintf (f, "Usage: %s [options] [-- command args...]\n", argv0);
   fprintf (f, "     -d,--device=/dev/...   input device to monitor\n");
   fprintf (f, "     -D,--debug             run in debug mode\n");
   fprintf (f, "     -f,--fbdev=/dev/...    framebuffer device (/dev/fb0)\n");
+  fprintf (f, "     --fb-dither=method     none, ordered, diffusion (ordered)\n");
+  fprintf (f, "     --fb-rotate=degrees    turn built-in savers clockwise (0)\n");
+  fprintf (f, "     --fb-threads=N         threads for built-in savers (0=all CPUs)\n");
+  fprintf (f, "     -g,--grace=seconds     time for saver to stop (5)\n");
   fprintf (f, "     -l,--log-level=N       log verbosity, 0-4\n");
+  fprintf (f, "     --max-restarts=N       restarts before blanking (5)\n");
+  fprintf (f, "     -p,--prewarm=seconds   start saver early, stopped (0)\n");
+  fprintf (f, "     --playlist=file        file of saver commands\n");
+  fprintf (f, "     --rotate=minutes       change saver while idle (0)\n");
+  fprintf (f, "     --saver=\"command...\"  add a saver command\n");
   fprintf (f, "     -t,--timeout=seconds   seconds to idle (120)\n");
-  fprintf (f, "Multiple input devices may be specified.\n");
+  fprintf (f, "     --daemon-nice=N        nice value for console-idle\n");
+  fprintf (f, "     --saver-cgroup=path    run saver in this cgroup\n");
+  fprintf (f, "     --saver-cpu-max=...    cgroup cpu.max for saver\n");
+  fprintf (f, "     --saver-cpus=N,N-N...  CPUs the saver may use\n");
+  fprintf (f, "     --saver-io-max=...     cgroup io.max for saver\n");
+  fprintf (f, "     --saver-memory-max=... cgroup memory.max for saver\n");
+  fprintf (f, "     --saver-nice=N         nice value for saver\n");
+  fprintf (f, "     --saver-sched=policy   idle, batch, or other\n");
+  fprintf (f, "Multiple input devices and savers may be specified.\n");
   }
 
 /*============================================================================
@@ -161,25 +221,89 @@ void console_idle_close_fdset (int ndevs, struct pollfd *fdset)
 
 /*============================================================================
   
-  console_idle_wait_for_idle
+  console_idle_parse_cpus
+
+  Parse a list of CPU numbers and ranges, like "0,2-3", into a cpu_set_t.
 
   ==========================================================================*/
-void console_idle_wait_for_idle (int ndevs, const struct pollfd *fdset_base, 
-        int timeout)
+BOOL console_idle_parse_cpus (const char *list, cpu_set_t *cpus)
   {
-  KLOG_IN
+  CPU_ZERO (cpus);
+  const char *p = list;
+  while (*p)
+    {
+    char *end;
+    long first = strtol (p, &end, 10);
+    if (end == p || first < 0 || first >= CPU_SETSIZE) return FALSE;
+    long last = first;
+    p = end;
+    if (*p == '-')
+      {
+      p++;
+      last = strtol (p, &end, 10);
+      if (end == p || last < first || last >= CPU_SETSIZE) return FALSE;
+      p = end;
+      }
+    for (long i = first; i <= last; i++)
+      CPU_SET (i, cpus);
+    if (*p == ',') 
+      p++;
+    else if (*p)
+      return FALSE;
+    }
+  return CPU_COUNT (cpus) > 0;
+  }
 
-  struct pollfd fdset [MAX_DEVS];
+/*============================================================================
+  
+  console_idle_parse_policy
 
-  int ticks = 0;
-  BOOL idle = FALSE;
-  klog_debug (KLOG_CLASS, "Waiting for %d second timeout", timeout); 
-  while (!idle && !stop)
+  Convert a scheduling policy name to a SCHED_XXX value, or -1 if the
+  name is not recognized.
+
+  ==========================================================================*/
+int console_idle_parse_policy (const char *name)
+  {
+  if (strcmp (name, "idle") == 0) return SCHED_IDLE;
+  if (strcmp (name, "batch") == 0) return SCHED_BATCH;
+  if (strcmp (name, "other") == 0) return SCHED_OTHER;
+  return -1;
+  }
+
+/*============================================================================
+  
+  console_idle_poll
+
+  Wait for input activity, for at most timeout_ms milliseconds (-1 means
+  wait indefinitely). The wait also ends early on a shutdown signal, and
+  whenever the screen-saver process needs attention, which is
+  dealt with here. Returns TRUE if there was input activity.
+
+  ==========================================================================*/
+BOOL console_idle_poll (int ndevs, const struct pollfd *fdset_base, 
+        SaverProcess *saver, int timeout_ms)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+
+  struct pollfd fdset [MAX_DEVS + NEXTRA_FDS];
+  memcpy (&fdset, fdset_base, ndevs * sizeof (struct pollfd));
+  fdset[ndevs].fd = stop_pipe[0];
+  fdset[ndevs].events = POLLIN;
+  fdset[ndevs + 1].fd = saver_process_get_fd (saver);
+  fdset[ndevs + 1].events = POLLIN;
+  fdset[ndevs + 2].fd = saver_process_get_notify_fd (saver);
+  fdset[ndevs + 2].events = POLLIN;
+
+  int saver_ms = saver_process_get_wait_ms (saver);
+  if (saver_ms >= 0 && (timeout_ms < 0 || saver_ms < timeout_ms))
+    timeout_ms = saver_ms;
+
+  int p = poll (fdset, ndevs + NEXTRA_FDS, timeout_ms);
+  if (p == 0) 
+    klog_debug (KLOG_CLASS, "poll() timed out");
+  if (p > 0)
     {
-    memcpy (&fdset, fdset_base, sizeof (fdset));
-    int p = poll (fdset, ndevs, 1000);
-    if (p <= 0) 
-      klog_debug (KLOG_CLASS, "poll() timed out");
     for (int i = 0; i < ndevs; i++)
       {
       if (fdset[i].revents & POLLIN)
@@ -188,86 +312,260 @@ void console_idle_wait_for_idle (int ndevs, const struct pollfd *fdset_base,
 	/* int n = */ read (fdset[i].fd, buff, sizeof (buff));
 	//klog_debug (KLOG_CLASS, "Read %d from %s", n, devs[i]);
 	klog_debug (KLOG_CLASS, "Resetting timeout");
-	ticks = 0;
+	ret = TRUE;
 	}
       }
-    ticks++;
-    if (ticks >= timeout) idle = TRUE;
+    if (fdset[ndevs].revents & POLLIN)
+      {
+      // The signal handler has already set 'stop' -- just drain the pipe
+      char buff[16];
+      read (stop_pipe[0], buff, sizeof (buff));
+      }
     }
 
+  saver_process_service (saver);
+
   KLOG_OUT
+  return ret;
   }
 
 /*============================================================================
   
-  console_idle_wait_for_active
+  console_idle_wait_for_idle
+
+  If prewarm is non-zero, the screen-saver program is started in a
+  stopped state that many seconds before the timeout expires, and
+  discarded if there is input activity before the timeout.
 
   ==========================================================================*/
-void console_idle_wait_for_active (int ndevs, const struct pollfd *fdset_base, 
-        int timeout)
+void console_idle_wait_for_idle (int ndevs, const struct pollfd *fdset_base, 
+        int timeout, int prewarm, SaverProcess *saver)
   {
   KLOG_IN
 
-  struct pollfd fdset [MAX_DEVS];
-
-  BOOL idle = TRUE;
+  int64_t deadline = monotime_ms() + timeout * 1000;
+  BOOL prewarm_done = (prewarm <= 0);
+  BOOL idle = FALSE;
   klog_debug (KLOG_CLASS, "Waiting for %d second timeout", timeout); 
-  while (idle && !stop)
+  while (!idle && !stop)
     {
-    memcpy (&fdset, fdset_base, sizeof (fdset));
-    int p = poll (fdset, ndevs, 1000);
-    if (p <= 0) 
-      klog_debug (KLOG_CLASS, "poll() timed out");
-    for (int i = 0; i < ndevs; i++)
+    // While the previous screen-saver is still shutting down, the
+    //   pre-warm time is no reason to wake up, even once it has passed;
+    //   its exit wakes poll() anyway
+    int64_t next = deadline;
+    if (!prewarm_done && !saver_process_is_active (saver))
+      next -= prewarm * 1000;
+
+    if (console_idle_poll (ndevs, fdset_base, saver, 
+          monotime_ms_until (next)))
       {
-      if (fdset[i].revents & POLLIN)
-	{
-	char buff[256];
-	/* int n = */ read (fdset[i].fd, buff, sizeof (buff));
-	//klog_debug (KLOG_CLASS, "Read %d from %s", n, devs[i]);
-	klog_debug (KLOG_CLASS, "Resetting timeout");
-        idle = FALSE;
-	}
+      deadline = monotime_ms() + timeout * 1000;
+      prewarm_done = (prewarm <= 0);
+      if (saver_process_is_prewarmed (saver))
+        saver_process_discard (saver);
+      }
+
+    int64_t now = monotime_ms();
+    if (now >= deadline) 
+      idle = TRUE;
+    else if (!prewarm_done && now >= deadline - prewarm * 1000 && 
+          !saver_process_is_active (saver))
+      {
+      // If the previous screen-saver is still shutting down, we'll
+      //   try again when it has gone
+      saver_process_prewarm (saver);
+      prewarm_done = TRUE;
       }
     }
 
+  if (stop && saver_process_is_prewarmed (saver))
+    saver_process_discard (saver);
+
   KLOG_OUT
   }
 
 /*============================================================================
   
-  console_idle_exec_prog
+  console_idle_start_saver
+
+  Start the current screen-saver in the playlist, or release it if it
+  has been pre-warmed, and then start prefetching the next one.
+  Built-in screen-savers are run by the engine, and are given the
+  snapshot directly.
 
   ==========================================================================*/
-int console_idle_exec_prog (int argc, char * const* argv)
+void console_idle_start_saver (SaverProcess *saver, SaverEngine *engine,
+        SaverPlaylist *playlist, const SaverSnapshot *fb_save)
   {
   KLOG_IN
-  int pid;
+  int argc;
+  char * const *argv = saver_playlist_get_current (playlist, &argc);
+  if (saver_process_is_prewarmed (saver))
+    saver_process_release (saver);
+  else if (saver_engine_is_builtin (argv[0]))
+    saver_engine_start (engine, argc, argv, 
+      saver_snapshot_get_bitmap (fb_save));
+  else
+    {
+    saver_process_set_command (saver, argc, argv);
+    saver_process_launch (saver);
+    klog_debug (KLOG_CLASS, "PID is %d", saver_process_get_pid (saver));
+    }
+  if (saver_playlist_get_length (playlist) > 1)
+    saver_playlist_prefetch_next (playlist);
+  KLOG_OUT
+  }
 
-  signal (SIGCHLD, SIG_IGN);
+/*============================================================================
+  
+  console_idle_stop_saver
 
-  klog_debug (KLOG_CLASS, "Executing command %s", argv[0]);
+  Ask the screen-saver to stop. A built-in screen-saver stops at once;
+  a screen-saver program is sent a signal, and supervised by the 
+  caller until it exits.
 
-  pid = fork(); 
-  if (pid == 0)
-    {
-    // Child
-    execvp (argv[0], argv); 
-    // We should never get here
-    klog_error (KLOG_CLASS, "Can't execute %s: %s\n", 
-       argv[0], strerror (errno));
-    } 
-  else if (pid > 0)
-    {
-    // parent
-    }
-  else
+  ==========================================================================*/
+void console_idle_stop_saver (SaverProcess *saver, SaverEngine *engine)
+  {
+  KLOG_IN
+  saver_engine_stop (engine);
+  saver_process_terminate (saver);
+  KLOG_OUT
+  }
+
+/*============================================================================
+  
+  console_idle_saver_is_active
+
+  ==========================================================================*/
+BOOL console_idle_saver_is_active (const SaverProcess *saver, 
+        const SaverEngine *engine)
+  {
+  return saver_engine_is_running (engine) || saver_process_is_active (saver);
+  }
+
+/*============================================================================
+  
+  console_idle_blank_framebuffer
+
+  ==========================================================================*/
+void console_idle_blank_framebuffer (FrameBuffer *fb)
+  {
+  KLOG_IN
+  framebuffer_init (fb, NULL);
+  framebuffer_clear (fb);
+  framebuffer_deinit (fb);
+  KLOG_OUT
+  }
+
+/*============================================================================
+  
+  console_idle_wait_for_active
+
+  If rotate is non-zero, and there is more than one screen-saver in
+  the playlist, the screen-saver is replaced with the next one every
+  rotate minutes. The new one is not started until the old one has
+  exited, so they never compete for the framebuffer.
+
+  Frames for a built-in screen-saver are drawn from this loop, which
+  sleeps until the next one is due.
+
+  If the screen-saver exits by itself, it is restarted after a delay
+  that doubles with each consecutive failure. After max_restarts
+  consecutive failures, the screen is blanked instead. A screen-saver
+  that has run for a reasonable time before exiting is not counted as
+  having failed repeatedly.
+
+  ==========================================================================*/
+void console_idle_wait_for_active (int ndevs, const struct pollfd *fdset_base, 
+        SaverProcess *saver, SaverEngine *engine, SaverPlaylist *playlist, 
+        int rotate, int max_restarts, FrameBuffer *fb, 
+        const SaverSnapshot *fb_save)
+  {
+  KLOG_IN
+
+  BOOL rotating = (rotate > 0 && saver_playlist_get_length (playlist) > 1);
+  int64_t rotate_at = monotime_ms() + rotate * 60000;
+  BOOL switching = FALSE;
+  int failures = 0;
+  int64_t restart_at = 0; // Zero when no restart is pending
+  BOOL given_up = FALSE;
+  BOOL idle = TRUE;
+  klog_debug (KLOG_CLASS, "Waiting for input activity"); 
+  while (idle && !stop)
     {
-    // Error
+    int64_t now = monotime_ms();
+
+    if (rotating && !switching && now >= rotate_at)
+      {
+      klog_debug (KLOG_CLASS, "Rotating to next screen-saver");
+      console_idle_stop_saver (saver, engine);
+      switching = TRUE;
+      }
+
+    if (restart_at != 0 && now >= restart_at)
+      {
+      restart_at = 0;
+      console_idle_start_saver (saver, engine, playlist, fb_save);
+      }
+
+    if (switching && !console_idle_saver_is_active (saver, engine))
+      {
+      // A new screen-saver gets a fresh start
+      failures = 0;
+      restart_at = 0;
+      given_up = FALSE;
+      saver_playlist_advance (playlist);
+      console_idle_start_saver (saver, engine, playlist, fb_save);
+      switching = FALSE;
+      rotate_at = now + rotate * 60000;
+      }
+    else if (!switching && restart_at == 0 && !given_up && 
+          !console_idle_saver_is_active (saver, engine))
+      {
+      // The screen-saver has exited by itself, or could not be started.
+      //   One whose exit status was lost may not have run properly,
+      //   however long it was around
+      if (saver_process_get_last_status (saver) != -1 &&
+          saver_process_get_last_runtime_ms (saver) >= STABLE_RUN_MS)
+        failures = 0;
+      failures++;
+      if (failures > max_restarts)
+        {
+        klog_warn (KLOG_CLASS, "Screen-saver failed %d times -- "
+          "blanking the screen instead", failures);
+        console_idle_blank_framebuffer (fb);
+        given_up = TRUE;
+        }
+      else
+        {
+        int delay = RESTART_MAX_MS;
+        if (failures <= 16) delay = RESTART_MIN_MS << (failures - 1);
+        if (delay > RESTART_MAX_MS) delay = RESTART_MAX_MS;
+        klog_warn (KLOG_CLASS, "Screen-saver exited -- restarting in %d ms",
+          delay);
+        restart_at = now + delay;
+        }
+      }
+
+    int wait_ms = -1;
+    if (rotating && !switching) wait_ms = monotime_ms_until (rotate_at);
+    if (restart_at != 0)
+      {
+      int restart_ms = monotime_ms_until (restart_at);
+      if (wait_ms < 0 || restart_ms < wait_ms) wait_ms = restart_ms;
+      }
+    int frame_ms = saver_engine_get_wait_ms (engine);
+    if (frame_ms >= 0 && (wait_ms < 0 || frame_ms < wait_ms)) 
+      wait_ms = frame_ms;
+
+    if (console_idle_poll (ndevs, fdset_base, saver, wait_ms))
+      idle = FALSE;
+    else
+      saver_engine_service (engine);
     }
 
   KLOG_OUT
-  return pid;
   }
 
 /*============================================================================
@@ -275,10 +573,10 @@ int console_idle_exec_prog (int argc, char * const* argv)
   console_idle_save_framebuffer
 
   ==========================================================================*/
-void console_init_save_framebuffer (FrameBuffer *fb, BitmapRGB *fb_save)
+void console_init_save_framebuffer (FrameBuffer *fb, SaverSnapshot *fb_save)
   {
   framebuffer_init (fb, NULL);
-  bitmaprgb_from_fb (fb_save, fb, 0, 0);
+  saver_snapshot_capture (fb_save, fb);
   framebuffer_deinit (fb);
   }
 
@@ -288,11 +586,15 @@ void console_init_save_framebuffer (FrameBuffer *fb, BitmapRGB *fb_save)
 
   ==========================================================================*/
 void console_init_restore_framebuffer (FrameBuffer *fb, 
-        BitmapRGB *fb_save)
+        const SaverSnapshot *fb_save)
   {
-  framebuffer_init (fb, NULL);
-  bitmaprgb_to_fb (fb_save, fb, 0, 0);
-  framebuffer_deinit (fb);
+  const BitmapRGB *bitmap = saver_snapshot_get_bitmap (fb_save);
+  if (bitmap)
+    {
+    framebuffer_init (fb, NULL);
+    bitmaprgb_to_fb (bitmap, fb, 0, 0);
+    framebuffer_deinit (fb);
+    }
   }
 
 /*============================================================================
@@ -338,10 +640,19 @@ void console_init_show_cursor (void)
   timeout --length of time to allow console to be idle
   devs -- array of devices to monitor for intput
   ndevs -- size of devs array
+  prewarm -- seconds before the timeout to start the screen-saver, stopped
+  rotate -- minutes between changes of screen-saver, or zero
+  playlist -- the screen-saver commands to run
+  max_restarts -- consecutive failures of the screen-saver to tolerate
+  saver -- the screen-saver process
+  engine -- runs built-in screen-savers
+  fb_save -- holds the screen contents while the screen-saver runs
 
   ==========================================================================*/
 void console_idle_main_loop (int timeout, int ndevs, char* const* devs,
-       int argc, char * const* argv, FrameBuffer *fb, BitmapRGB *fb_save)
+       int prewarm, int rotate, SaverPlaylist *playlist, int max_restarts,
+       SaverProcess *saver, SaverEngine *engine, FrameBuffer *fb, 
+       SaverSnapshot *fb_save)
   {
   KLOG_IN
   struct pollfd fdset_base [MAX_DEVS];
@@ -353,28 +664,48 @@ void console_idle_main_loop (int timeout, int ndevs, char* const* devs,
 
      while (!stop)
       {
+      // Set the command now, in case it is pre-warmed
+      int saver_argc;
+      char * const *saver_argv = saver_playlist_get_current (playlist, 
+        &saver_argc);
+      saver_process_set_command (saver, saver_argc, saver_argv);
+      // The snapshot's fd must also be known before pre-warming, even 
+      //   though the snapshot itself can't be taken until we are idle
+      saver_snapshot_prepare (fb_save);
+      saver_process_set_snapshot (saver, saver_snapshot_get_fd (fb_save),
+        saver_snapshot_get_width (fb_save), 
+        saver_snapshot_get_height (fb_save));
+
       console_idle_init_fdset (ndevs, devs, fdset_base);
-      console_idle_wait_for_idle (ndevs, fdset_base, timeout);
+      // There's nothing to pre-warm for a built-in screen-saver
+      console_idle_wait_for_idle (ndevs, fdset_base, timeout, 
+        saver_engine_is_builtin (saver_argv[0]) ? 0 : prewarm, saver);
       console_idle_close_fdset (ndevs, fdset_base);
+      if (stop) break;
 
       // Save framebuffer 
       console_init_hide_cursor ();
       console_init_save_framebuffer (fb, fb_save);
-      int pid = console_idle_exec_prog (argc, argv); 
-      klog_debug (KLOG_CLASS, "PID is %d", pid);    
+      console_idle_start_saver (saver, engine, playlist, fb_save);
 
       console_idle_init_fdset (ndevs, devs, fdset_base);
-      console_idle_wait_for_active (ndevs, fdset_base, timeout);
+      console_idle_wait_for_active (ndevs, fdset_base, saver, engine, 
+        playlist, rotate, max_restarts, fb, fb_save);
       console_idle_close_fdset (ndevs, fdset_base);
 
-      // Kill child process
-      kill (pid, SIGTERM);
+      // Kill child process, and give it a chance to say that it 
+      //   has finished with the framebuffer
+      console_idle_stop_saver (saver, engine);
+      saver_process_wait_stopped (saver);
 
       // Restore framebuffer 
       console_init_restore_framebuffer (fb, fb_save);
       console_init_show_cursor ();
+
+      saver_playlist_advance (playlist);
       }
     }
+  saver_process_wait (saver);
   KLOG_OUT
   } 
 
@@ -387,6 +718,7 @@ void console_idle_quit (int dummy)
   {
   klog_info (KLOG_CLASS, "Shutting down on signal");
   stop = TRUE;
+  write (stop_pipe[1], "", 1);
   }
 
 /*============================================================================
@@ -408,7 +740,26 @@ int console_idle_main (int argc, char **argv)
   char *devs [MAX_DEVS];
   int ndev_in = 0;
   int timeout = DEFAULT_TIMEOUT;
+  int prewarm = 0;
+  int grace = DEFAULT_GRACE;
+  int rotate = 0;
+  BitmapRGBTransform fb_transform = BITMAPRGB_TRANSFORM_NONE;
+  BitmapRGBDither fb_dither = BITMAPRGB_DITHER_ORDERED;
+  int fb_threads = 0;
+  int max_restarts = DEFAULT_MAX_RESTARTS;
+  SaverPlaylist *playlist = saver_playlist_create ();
   char *fbdev = NULL;
+  char *cgroup_path = NULL;
+  char *cpu_max = NULL;
+  char *memory_max = NULL;
+  char *io_max = NULL;
+  BOOL set_saver_nice = FALSE;
+  int saver_nice = 0;
+  int saver_policy = -1;
+  BOOL set_saver_cpus = FALSE;
+  cpu_set_t saver_cpus;
+  BOOL set_daemon_nice = FALSE;
+  int daemon_nice = 0;
 
   int log_level = KLOG_WARN;
 
@@ -419,8 +770,25 @@ int console_idle_main (int argc, char **argv)
       {"device", required_argument, NULL, 'd'},
       {"debug", no_argument, NULL, 'D'},
       {"fbdev", required_argument, NULL, 'f'},
+      {"grace", required_argument, NULL, 'g'},
       {"log-level", required_argument, NULL, 'l'},
+      {"prewarm", required_argument, NULL, 'p'},
       {"timeout", required_argument, NULL, 't'},
+      {"saver-cgroup", required_argument, NULL, OPT_SAVER_CGROUP},
+      {"saver-cpu-max", required_argument, NULL, OPT_SAVER_CPU_MAX},
+      {"saver-memory-max", required_argument, NULL, OPT_SAVER_MEMORY_MAX},
+      {"saver-io-max", required_argument, NULL, OPT_SAVER_IO_MAX},
+      {"saver-nice", required_argument, NULL, OPT_SAVER_NICE},
+      {"saver-sched", required_argument, NULL, OPT_SAVER_SCHED},
+      {"saver-cpus", required_argument, NULL, OPT_SAVER_CPUS},
+      {"daemon-nice", required_argument, NULL, OPT_DAEMON_NICE},
+      {"saver", required_argument, NULL, OPT_SAVER},
+      {"playlist", required_argument, NULL, OPT_PLAYLIST},
+      {"rotate", required_argument, NULL, OPT_ROTATE},
+      {"max-restarts", required_argument, NULL, OPT_MAX_RESTARTS},
+      {"fb-rotate", required_argument, NULL, OPT_FB_ROTATE},
+      {"fb-dither", required_argument, NULL, OPT_FB_DITHER},
+      {"fb-threads", required_argument, NULL, OPT_FB_THREADS},
       {0, 0, 0, 0}
     };
 
@@ -429,7 +797,7 @@ int console_idle_main (int argc, char **argv)
    while (ret == 0)
      {
      int option_index = 0;
-     opt = getopt_long (argc, argv, "vhdl:d:t:f:D",
+     opt = getopt_long (argc, argv, "vhdl:d:t:f:Dp:g:",
      long_options, &option_index);
 
      if (opt == -1) break;
@@ -448,6 +816,91 @@ int console_idle_main (int argc, char **argv)
          log_level = atoi (optarg); break;
        case 't':
          timeout = atoi (optarg); break;
+       case 'p':
+         prewarm = atoi (optarg); break;
+       case 'g':
+         grace = atoi (optarg); break;
+       case OPT_SAVER_CGROUP:
+         cgroup_path = strdup (optarg); break;
+       case OPT_SAVER_CPU_MAX:
+         cpu_max = strdup (optarg); break;
+       case OPT_SAVER_MEMORY_MAX:
+         memory_max = strdup (optarg); break;
+       case OPT_SAVER_IO_MAX:
+         io_max = strdup (optarg); break;
+       case OPT_SAVER_NICE:
+         set_saver_nice = TRUE;
+         saver_nice = atoi (optarg); break;
+       case OPT_SAVER_SCHED:
+         saver_policy = console_idle_parse_policy (optarg);
+         if (saver_policy < 0)
+           {
+           klog_error (KLOG_CLASS, "Unknown scheduling policy: %s", optarg);
+           ret = EINVAL;
+           }
+         break;
+       case OPT_SAVER_CPUS:
+         set_saver_cpus = TRUE;
+         if (!console_idle_parse_cpus (optarg, &saver_cpus))
+           {
+           klog_error (KLOG_CLASS, "Invalid CPU list: %s", optarg);
+           ret = EINVAL;
+           }
+         break;
+       case OPT_DAEMON_NICE:
+         set_daemon_nice = TRUE;
+         daemon_nice = atoi (optarg); break;
+       case OPT_SAVER:
+         if (!saver_playlist_add_command (playlist, optarg))
+           {
+           klog_error (KLOG_CLASS, "Empty screen-saver command");
+           ret = EINVAL;
+           }
+         break;
+       case OPT_PLAYLIST:
+         {
+         char *error = NULL;
+         if (!saver_playlist_load (playlist, optarg, &error))
+           {
+           klog_error (KLOG_CLASS, "%s", error);
+           free (error);
+           ret = EINVAL;
+           }
+         }
+         break;
+       case OPT_ROTATE:
+         rotate = atoi (optarg); break;
+       case OPT_MAX_RESTARTS:
+         max_restarts = atoi (optarg); break;
+       case OPT_FB_ROTATE:
+         switch (atoi (optarg))
+           {
+           case 0: fb_transform = BITMAPRGB_TRANSFORM_NONE; break;
+           case 90: fb_transform = BITMAPRGB_TRANSFORM_ROTATE_90; break;
+           case 180: fb_transform = BITMAPRGB_TRANSFORM_ROTATE_180; break;
+           case 270: fb_transform = BITMAPRGB_TRANSFORM_ROTATE_270; break;
+           default:
+             klog_error (KLOG_CLASS, "Rotation must be 0, 90, 180 or 270: %s",
+               optarg);
+             ret = EINVAL;
+           }
+         break;
+       case OPT_FB_DITHER:
+         if (strcmp (optarg, "none") == 0)
+           fb_dither = BITMAPRGB_DITHER_NONE;
+         else if (strcmp (optarg, "ordered") == 0)
+           fb_dither = BITMAPRGB_DITHER_ORDERED;
+         else if (strcmp (optarg, "diffusion") == 0)
+           fb_dither = BITMAPRGB_DITHER_DIFFUSION;
+         else
+           {
+           klog_error (KLOG_CLASS, 
+             "Dither must be none, ordered or diffusion: %s", optarg);
+           ret = EINVAL;
+           }
+         break;
+       case OPT_FB_THREADS:
+         fb_threads = atoi (optarg); break;
        case 'd':
          if (ndev_in < MAX_DEVS - 1)
            {
@@ -479,17 +932,26 @@ int console_idle_main (int argc, char **argv)
     ret = -1;
     }
 
+  if (ret == 0 && (prewarm < 0 || prewarm >= timeout))
+    {
+    klog_error (KLOG_CLASS, 
+      "Pre-warm time must be less than the timeout");
+    ret = -1;
+    }
+
   LogContext log_context;
   log_context.debug = debug;
   klog_init (log_level, console_idle_log_handler, &log_context);
 
-  int new_argc = argc - optind; 
-  char **new_argv = malloc ((new_argc + 1) * sizeof (char *));
-  for (int i = 0; i < new_argc; i++)
+  if (optind < argc)
+    saver_playlist_add_argv (playlist, argc - optind, argv + optind);
+
+  if (ret == 0 && saver_playlist_get_length (playlist) == 0)
     {
-    new_argv [i] = strdup (argv[optind + i]);
+    klog_error (KLOG_CLASS, 
+      "No screen-saver command was specified. Use -- command...");
+    ret = -1;
     }
-  new_argv[new_argc] = NULL;   
 
   if (fbdev == NULL)
     {
@@ -504,7 +966,7 @@ int console_idle_main (int argc, char **argv)
     {
     klog_debug (KLOG_CLASS, "Framebuffer initialization OK");
     fb_w = framebuffer_get_width (fb);
-    fb_h = framebuffer_get_width (fb);
+    fb_h = framebuffer_get_height (fb);
     }
   else
     {
@@ -512,10 +974,39 @@ int console_idle_main (int argc, char **argv)
     free (error);
     }
 
-  if (ret == 0)
+  // Any cgroup setting implies that we want a cgroup
+  SaverCgroup *cgroup = NULL;
+  if (ret == 0 && (cgroup_path || cpu_max || memory_max || io_max))
     {
-    BitmapRGB *fb_save = bitmaprgb_create (fb_w, fb_h); 
+    cgroup = saver_cgroup_create (cgroup_path, cpu_max, memory_max, io_max);
+    if (!saver_cgroup_init (cgroup, &error))
+      {
+      klog_error (KLOG_CLASS, "%s", error);
+      free (error);
+      ret = -1;
+      }
+    }
 
+  if (ret == 0)
+    {
+    SaverSnapshot *fb_save = saver_snapshot_create (fb_w, fb_h); 
+    SaverEngine *engine = saver_engine_create (fb);
+    saver_engine_set_transform (engine, fb_transform);
+    saver_engine_set_dither (engine, fb_dither);
+    saver_engine_set_threads (engine, fb_threads);
+    int saver_argc;
+    char * const *saver_argv = saver_playlist_get_current (playlist, 
+      &saver_argc);
+    SaverProcess *saver = saver_process_create (saver_argc, saver_argv, 
+      grace);
+    if (cgroup) saver_process_set_cgroup (saver, cgroup);
+    // The screen-saver must not inherit an elevated priority from us
+    if (set_saver_nice || (set_daemon_nice && daemon_nice < 0))
+      saver_process_set_nice (saver, set_saver_nice ? saver_nice : 0);
+    if (saver_policy >= 0) saver_process_set_policy (saver, saver_policy);
+    if (set_saver_cpus) saver_process_set_cpus (saver, &saver_cpus);
+
+    pipe2 (stop_pipe, O_CLOEXEC | O_NONBLOCK);
     signal (SIGQUIT, console_idle_quit);
     signal (SIGTERM, console_idle_quit);
     signal (SIGHUP, console_idle_quit);
@@ -524,19 +1015,29 @@ int console_idle_main (int argc, char **argv)
     if (!debug)
       daemon (0, 0);
 
-    console_idle_main_loop (timeout, ndev_in, devs, new_argc, new_argv, 
-             fb, fb_save);
-    bitmaprgb_destroy (fb_save);
+    if (set_daemon_nice && setpriority (PRIO_PROCESS, 0, daemon_nice) != 0)
+      klog_warn (KLOG_CLASS, "Can't set nice value %d: %s", daemon_nice,
+        strerror (errno));
+
+    console_idle_main_loop (timeout, ndev_in, devs, prewarm, rotate, 
+             playlist, max_restarts, saver, engine, fb, fb_save);
+    saver_engine_destroy (engine);
+    saver_process_destroy (saver);
+    saver_snapshot_destroy (fb_save);
     }
+
+  if (cgroup) saver_cgroup_destroy (cgroup);
   
-  for (int i = 0; i < new_argc; i++)
-    free (new_argv[i]);
-  free (new_argv);
+  saver_playlist_destroy (playlist);
 
   for (int i = 0; i < ndev_in; i++)
     free (devs[i]);
 
   if (fbdev) free (fbdev);
+  if (cgroup_path) free (cgroup_path);
+  if (cpu_max) free (cpu_max);
+  if (memory_max) free (memory_max);
+  if (io_max) free (io_max);
 
   framebuffer_destroy (fb);
 
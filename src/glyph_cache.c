@@ -0,0 +1,138 @@
+/*============================================================================
+
+  console-idle
+
+  glyph_cache.c
+
+  Only the first GLYPH_CACHE_SIZE character codes are cached, which is
+  all that a console font can be relied upon to map directly. Anything
+  else is drawn as '?'.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <klib/klib.h>
+#include "glyph_cache.h"
+
+#define KLOG_CLASS "console_idle.glyph_cache"
+
+#define GLYPH_CACHE_SIZE 256
+
+struct _GlyphCache
+  {
+  const PsfFont *font; // Not owned by this object
+  int scale;
+  BYTE r, g, b;
+  BYTE bg_r, bg_g, bg_b;
+  BitmapRGB *glyphs[GLYPH_CACHE_SIZE]; // NULL until first rendered
+  };
+
+/*============================================================================
+
+  glyph_cache_create
+
+  ==========================================================================*/
+GlyphCache *glyph_cache_create (const PsfFont *font, int scale,
+       BYTE r, BYTE g, BYTE b, BYTE bg_r, BYTE bg_g, BYTE bg_b)
+  {
+  KLOG_IN
+  GlyphCache *self = malloc (sizeof (GlyphCache));
+  self->font = font;
+  self->scale = scale > 0 ? scale : 1;
+  self->r = r;
+  self->g = g;
+  self->b = b;
+  self->bg_r = bg_r;
+  self->bg_g = bg_g;
+  self->bg_b = bg_b;
+  memset (self->glyphs, 0, sizeof (self->glyphs));
+  KLOG_OUT
+  return self;
+  }
+
+/*============================================================================
+
+  glyph_cache_destroy
+
+  ==========================================================================*/
+void glyph_cache_destroy (GlyphCache *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    for (int i = 0; i < GLYPH_CACHE_SIZE; i++)
+      {
+      if (self->glyphs[i]) bitmaprgb_destroy (self->glyphs[i]);
+      }
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  glyph_cache_render
+
+  ==========================================================================*/
+static BitmapRGB *glyph_cache_render (const GlyphCache *self, int ch)
+  {
+  int w = psf_font_get_width (self->font);
+  int h = psf_font_get_height (self->font);
+  int row_bytes = psf_font_get_row_bytes (self->font);
+  const BYTE *glyph = psf_font_get_glyph (self->font, ch);
+  int scale = self->scale;
+
+  BitmapRGB *bitmap = bitmaprgb_create (w * scale, h * scale);
+  if (!bitmap) return NULL;
+  bitmaprgb_fill_rect (bitmap, 0, 0, w * scale, h * scale,
+    self->bg_r, self->bg_g, self->bg_b);
+  for (int y = 0; y < h; y++)
+    {
+    const BYTE *row = glyph + y * row_bytes;
+    for (int x = 0; x < w; x++)
+      {
+      if (row[x / 8] & (0x80 >> (x % 8)))
+        bitmaprgb_fill_rect (bitmap, x * scale, y * scale,
+          (x + 1) * scale, (y + 1) * scale, self->r, self->g, self->b);
+      }
+    }
+  return bitmap;
+  }
+
+/*============================================================================
+
+  glyph_cache_get
+
+  ==========================================================================*/
+const BitmapRGB *glyph_cache_get (GlyphCache *self, int ch)
+  {
+  if (ch < 0 || ch >= GLYPH_CACHE_SIZE) ch = '?';
+  if (!self->glyphs[ch])
+    self->glyphs[ch] = glyph_cache_render (self, ch);
+  return self->glyphs[ch];
+  }
+
+/*============================================================================
+
+  glyph_cache_get_cell_width
+
+  ==========================================================================*/
+int glyph_cache_get_cell_width (const GlyphCache *self)
+  {
+  return psf_font_get_width (self->font) * self->scale;
+  }
+
+/*============================================================================
+
+  glyph_cache_get_cell_height
+
+  ==========================================================================*/
+int glyph_cache_get_cell_height (const GlyphCache *self)
+  {
+  return psf_font_get_height (self->font) * self->scale;
+  }
+
@@ -0,0 +1,43 @@
+/*============================================================================
+
+  console-idle
+
+  glyph_cache.h
+
+  A "class" that holds the glyphs of a PsfFont, enlarged by a whole-number
+  scale factor and rendered in fixed colours, as bitmaps ready to be
+  copied onto a canvas. Each glyph is rendered the first time it is
+  asked for, and kept until the cache is destroyed; drawing a
+  character is then just a bitmap copy.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+#include "psf_font.h"
+
+struct _GlyphCache;
+typedef struct _GlyphCache GlyphCache;
+
+BEGIN_DECLS
+
+/** Create a cache for the specified font, which is not owned by the
+    cache, and must remain valid until it is destroyed. */
+GlyphCache    *glyph_cache_create (const PsfFont *font, int scale,
+                  BYTE r, BYTE g, BYTE b, BYTE bg_r, BYTE bg_g, BYTE bg_b);
+
+void           glyph_cache_destroy (GlyphCache *self);
+
+/** Get the bitmap for a character, rendering it if necessary. Returns
+    NULL if there is not enough memory to render it. */
+const BitmapRGB *glyph_cache_get (GlyphCache *self, int ch);
+
+/** Get the size of a character cell, in pixels. */
+int            glyph_cache_get_cell_width (const GlyphCache *self);
+int            glyph_cache_get_cell_height (const GlyphCache *self);
+
+END_DECLS
+
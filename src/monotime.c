@@ -0,0 +1,39 @@
+/*============================================================================
+
+  console-idle
+
+  monotime.c
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#include <time.h>
+#include <limits.h>
+#include "monotime.h"
+
+/*============================================================================
+
+  monotime_ms
+
+  ==========================================================================*/
+int64_t monotime_ms (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  }
+
+/*============================================================================
+
+  monotime_ms_until
+
+  ==========================================================================*/
+int monotime_ms_until (int64_t deadline)
+  {
+  int64_t remaining = deadline - monotime_ms();
+  if (remaining < 0) return 0;
+  if (remaining > INT_MAX) return INT_MAX;
+  return (int)remaining;
+  }
+
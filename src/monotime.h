@@ -0,0 +1,33 @@
+/*============================================================================
+
+  console-idle
+
+  monotime.h
+
+  Helpers for working with the monotonic system clock, which is not
+  affected by changes to the time of day.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <stdint.h>
+#include <klib/klib.h>
+
+BEGIN_DECLS
+
+/** Get the current value of the monotonic clock, in milliseconds. The 
+    value has no meaning in itself, but differences between values are
+    elapsed times. */
+int64_t monotime_ms (void);
+
+/** Get the number of milliseconds remaining before the specified 
+    deadline (a value returned by monotime_ms(), plus some interval), 
+    in a form suitable for passing to poll(). The result is never 
+    negative. */
+int     monotime_ms_until (int64_t deadline);
+
+END_DECLS
+
@@ -0,0 +1,261 @@
+/*============================================================================
+
+  console-idle
+
+  psf_font.c
+
+  The glyphs are held in one block of memory, glyph_bytes apart, in the
+  same layout as a PSF file. Fonts read from the console are
+  repacked into this layout, because the kernel always pads each glyph
+  to 32 rows.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/kd.h>
+#include <klib/klib.h>
+#include "psf_font.h"
+
+#define KLOG_CLASS "console_idle.psf_font"
+
+#define PSF1_MAGIC0 0x36
+#define PSF1_MAGIC1 0x04
+#define PSF1_MODE512 0x01
+#define PSF2_MAGIC 0x864ab572
+
+// Limits on what the kernel will return from KD_FONT_OP_GET
+#define CONSOLE_FONT_MAX_CHARS 512
+#define CONSOLE_FONT_MAX_WIDTH 32
+#define CONSOLE_FONT_PITCH 32
+
+struct _PsfFont
+  {
+  int width;
+  int height;
+  int row_bytes;
+  int glyph_bytes;
+  int nglyphs;
+  BYTE *glyphs;
+  };
+
+/*============================================================================
+
+  psf_font_new
+
+  Create a font with space for the glyphs, but no glyph data
+
+  ==========================================================================*/
+static PsfFont *psf_font_new (int width, int height, int nglyphs)
+  {
+  PsfFont *self = malloc (sizeof (PsfFont));
+  self->width = width;
+  self->height = height;
+  self->row_bytes = (width + 7) / 8;
+  self->glyph_bytes = self->row_bytes * height;
+  self->nglyphs = nglyphs;
+  self->glyphs = malloc ((size_t)self->glyph_bytes * nglyphs);
+  return self;
+  }
+
+/*============================================================================
+
+  psf_font_get_le32
+
+  ==========================================================================*/
+static uint32_t psf_font_get_le32 (const BYTE *p)
+  {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+/*============================================================================
+
+  psf_font_parse
+
+  Make a font from the contents of a PSF file. Returns NULL if the
+  contents are not valid.
+
+  ==========================================================================*/
+static PsfFont *psf_font_parse (const BYTE *data, size_t size)
+  {
+  int width, height, nglyphs, glyph_bytes;
+  size_t offset;
+
+  if (size >= 4 && data[0] == PSF1_MAGIC0 && data[1] == PSF1_MAGIC1)
+    {
+    width = 8;
+    height = data[3];
+    glyph_bytes = height;
+    nglyphs = (data[2] & PSF1_MODE512) ? 512 : 256;
+    offset = 4;
+    }
+  else if (size >= 32 && psf_font_get_le32 (data) == PSF2_MAGIC)
+    {
+    offset = psf_font_get_le32 (data + 8);
+    nglyphs = psf_font_get_le32 (data + 16);
+    glyph_bytes = psf_font_get_le32 (data + 20);
+    height = psf_font_get_le32 (data + 24);
+    width = psf_font_get_le32 (data + 28);
+    }
+  else
+    return NULL;
+
+  if (width <= 0 || height <= 0 || nglyphs <= 0 || width > 256
+       || height > 256 || nglyphs > 65536
+       || glyph_bytes != (width + 7) / 8 * height
+       || offset + (size_t)glyph_bytes * nglyphs > size)
+    return NULL;
+
+  PsfFont *self = psf_font_new (width, height, nglyphs);
+  memcpy (self->glyphs, data + offset, (size_t)glyph_bytes * nglyphs);
+  return self;
+  }
+
+/*============================================================================
+
+  psf_font_load
+
+  ==========================================================================*/
+PsfFont *psf_font_load (const char *file, char **error)
+  {
+  KLOG_IN
+  PsfFont *ret = NULL;
+  int fd = open (file, O_RDONLY | O_CLOEXEC);
+  if (fd >= 0)
+    {
+    struct stat sb;
+    if (fstat (fd, &sb) == 0)
+      {
+      BYTE *data = malloc (sb.st_size);
+      if (read (fd, data, sb.st_size) == sb.st_size)
+        {
+        ret = psf_font_parse (data, sb.st_size);
+        if (ret)
+          klog_debug (KLOG_CLASS, "Loaded %dx%d font %s", ret->width,
+            ret->height, file);
+        else if (error)
+          asprintf (error, "%s is not an uncompressed PSF font", file);
+        }
+      else if (error)
+        asprintf (error, "Can't read %s: %s", file, strerror (errno));
+      free (data);
+      }
+    else if (error)
+      asprintf (error, "Can't read %s: %s", file, strerror (errno));
+    close (fd);
+    }
+  else if (error)
+    asprintf (error, "Can't open %s: %s", file, strerror (errno));
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  psf_font_from_console
+
+  ==========================================================================*/
+PsfFont *psf_font_from_console (const char *tty, char **error)
+  {
+  KLOG_IN
+  PsfFont *ret = NULL;
+  int fd = open (tty, O_RDONLY | O_CLOEXEC);
+  if (fd >= 0)
+    {
+    struct console_font_op op;
+    memset (&op, 0, sizeof (op));
+    op.op = KD_FONT_OP_GET;
+    op.width = CONSOLE_FONT_MAX_WIDTH;
+    op.height = CONSOLE_FONT_PITCH;
+    op.charcount = CONSOLE_FONT_MAX_CHARS;
+    op.data = malloc (CONSOLE_FONT_MAX_CHARS * CONSOLE_FONT_PITCH
+      * (CONSOLE_FONT_MAX_WIDTH / 8));
+    if (ioctl (fd, KDFONTOP, &op) == 0)
+      {
+      ret = psf_font_new (op.width, op.height, op.charcount);
+      int pitch_bytes = ret->row_bytes * CONSOLE_FONT_PITCH;
+      for (int i = 0; i < ret->nglyphs; i++)
+        memcpy (ret->glyphs + i * ret->glyph_bytes,
+          op.data + i * pitch_bytes, ret->glyph_bytes);
+      klog_debug (KLOG_CLASS, "Read %dx%d font from %s", ret->width,
+        ret->height, tty);
+      }
+    else if (error)
+      asprintf (error, "Can't get font from %s: %s", tty, strerror (errno));
+    free (op.data);
+    close (fd);
+    }
+  else if (error)
+    asprintf (error, "Can't open %s: %s", tty, strerror (errno));
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  psf_font_destroy
+
+  ==========================================================================*/
+void psf_font_destroy (PsfFont *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    free (self->glyphs);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  psf_font_get_width
+
+  ==========================================================================*/
+int psf_font_get_width (const PsfFont *self)
+  {
+  return self->width;
+  }
+
+/*============================================================================
+
+  psf_font_get_height
+
+  ==========================================================================*/
+int psf_font_get_height (const PsfFont *self)
+  {
+  return self->height;
+  }
+
+/*============================================================================
+
+  psf_font_get_row_bytes
+
+  ==========================================================================*/
+int psf_font_get_row_bytes (const PsfFont *self)
+  {
+  return self->row_bytes;
+  }
+
+/*============================================================================
+
+  psf_font_get_glyph
+
+  ==========================================================================*/
+const BYTE *psf_font_get_glyph (const PsfFont *self, int ch)
+  {
+  if (ch < 0 || ch >= self->nglyphs) ch = '?';
+  if (ch >= self->nglyphs) ch = 0;
+  return self->glyphs + (size_t)ch * self->glyph_bytes;
+  }
+
@@ -0,0 +1,50 @@
+/*============================================================================
+
+  console-idle
+
+  psf_font.h
+
+  A "class" that holds a bitmap font in the format used for the Linux
+  console, either loaded from a PSF (version 1 or 2) file, or read
+  from the console itself. Each glyph is stored as a sequence of rows,
+  of psf_font_get_row_bytes() bytes each, with the most significant bit
+  of the first byte being the left-most pixel.
+
+  Compressed (.psf.gz) files are not supported, and any Unicode table
+  in the file is ignored: character codes are taken to be glyph
+  numbers, which is correct for ASCII in all the usual console fonts.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+
+struct _PsfFont;
+typedef struct _PsfFont PsfFont;
+
+BEGIN_DECLS
+
+/** Load a font from a PSF file. If this method fails, it returns NULL,
+    and error is set, and must be freed by the caller. */
+PsfFont       *psf_font_load (const char *file, char **error);
+
+/** Get a copy of the font that the console is using, by means of the
+    KDFONTOP ioctl() on the specified tty. If this method fails, it
+    returns NULL, and error is set, and must be freed by the caller. */
+PsfFont       *psf_font_from_console (const char *tty, char **error);
+
+void           psf_font_destroy (PsfFont *self);
+
+int            psf_font_get_width (const PsfFont *self);
+int            psf_font_get_height (const PsfFont *self);
+int            psf_font_get_row_bytes (const PsfFont *self);
+
+/** Get the rows of the glyph for a character. Characters that are not
+    in the font are shown as the glyph for '?'. */
+const BYTE    *psf_font_get_glyph (const PsfFont *self, int ch);
+
+END_DECLS
+
@@ -0,0 +1,123 @@
+/*============================================================================
+
+  console-idle
+
+  saver_builtin.h
+
+  The interface to screen-savers that run inside console-idle itself,
+  rather than as separate programs. Each built-in screen-saver is
+  described by a SaverBuiltin structure, whose functions are called
+  by the SaverEngine as follows:
+
+  init -- once, when the screen-saver starts
+  render_frame -- whenever a frame is due
+  stop -- once, when the screen-saver is no longer wanted
+
+  All drawing is done on an off-screen canvas, the same size as the
+  framebuffer, which the engine copies to the screen after each frame.
+  Only the areas that have changed are copied: the canvas tracks the
+  damage done by the bitmaprgb_ drawing functions, and render_frame
+  must report anything else -- changes made directly to the pixel
+  data, or areas that must be copied although they have not changed.
+  Screen-savers that can prepare their pixels in the framebuffer's own
+  format -- an image that is shown for many frames, for example -- may
+  draw on the frame in SaverEnv instead, and report those areas 
+  separately; they are copied with no conversion at all.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+#include "psf_font.h"
+
+// A rectangle, in pixels. An empty rectangle has w or h zero
+typedef struct _SaverRect
+  {
+  int x;
+  int y;
+  int w;
+  int h;
+  } SaverRect;
+
+// Most separate areas that can be reported as changed in one frame
+#define SAVER_MAX_DAMAGE 16
+
+// The areas of the canvas changed by one frame
+typedef struct _SaverDamage
+  {
+  int n;
+  SaverRect rects[SAVER_MAX_DAMAGE];
+  // Areas of SaverEnv.frame, copied to the screen after those above
+  int n_frame;
+  SaverRect frame_rects[SAVER_MAX_DAMAGE];
+  } SaverDamage;
+
+// Things provided by console-idle that a screen-saver may use. Any of
+//  them may be NULL
+typedef struct _SaverEnv
+  {
+  // A copy of the screen as it was before the screen-saver started
+  const BitmapRGB *snapshot;
+  // The font that the console was using when console-idle started
+  const PsfFont *console_font;
+  // A bitmap the size of the canvas, in the framebuffer's own format,
+  //  or NULL if the framebuffer is turned, so the canvas has to be as 
+  //  well. It starts black
+  BitmapFB *frame;
+  // How to reduce colours when converting to the frame's format
+  BitmapRGBDither dither;
+  // Threads to share out drawing that covers much of the screen, with
+  //  the tiled bitmap functions. Jobs run from different threads take
+  //  turns
+  KThreadPool *pool;
+  } SaverEnv;
+
+typedef struct _SaverBuiltin
+  {
+  // The name by which the screen-saver is selected, as "builtin:name"
+  const char *name;
+
+  /** Set up the screen-saver, storing whatever state it needs in
+      *state. The canvas is black to start with. Everything in env
+      remains valid until stop() is called. argv[0] is the name
+      of the screen-saver, and the rest are its arguments. Returns
+      FALSE if the screen-saver can't run. */
+  BOOL (*init) (void **state, BitmapRGB *canvas, const SaverEnv *env,
+        int argc, char * const *argv);
+
+  /** Draw one frame on the canvas. dt_ms is the time since the last
+      frame, or zero for the first. Areas changed other than by the
+      bitmaprgb_ functions must be added to damage using 
+      saver_damage_add(), and those drawn on the frame using
+      saver_damage_add_frame(). Returns the time in milliseconds
+      until the next frame is wanted, or -1 if no more frames are 
+      needed -- the screen then stays as it is until the screen-saver
+      is stopped. */
+  int (*render_frame) (void *state, BitmapRGB *canvas, int dt_ms,
+        SaverDamage *damage);
+
+  /** Free the state. The screen is restored by the caller. */
+  void (*stop) (void *state);
+  } SaverBuiltin;
+
+BEGIN_DECLS
+
+/** Record that an area of the canvas has changed. If there are too
+    many separate areas, the last one is enlarged to cover the new one
+    as well. Empty areas are ignored. */
+void saver_damage_add (SaverDamage *damage, int x, int y, int w, int h);
+
+/** As saver_damage_add(), but for an area of the frame. */
+void saver_damage_add_frame (SaverDamage *damage, int x, int y, 
+       int w, int h);
+
+extern const SaverBuiltin saver_builtin_blank;
+extern const SaverBuiltin saver_builtin_fade;
+extern const SaverBuiltin saver_builtin_clock;
+extern const SaverBuiltin saver_builtin_slideshow;
+
+END_DECLS
+
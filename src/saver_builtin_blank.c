@@ -0,0 +1,60 @@
+/*============================================================================
+
+  console-idle
+
+  saver_builtin_blank.c
+
+  A built-in screen-saver that just blanks the screen. It draws one
+  frame, and then uses no CPU at all until it is stopped.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#include <klib/klib.h>
+#include "saver_builtin.h"
+
+/*============================================================================
+
+  blank_init
+
+  ==========================================================================*/
+static BOOL blank_init (void **state, BitmapRGB *canvas,
+       const SaverEnv *env, int argc, char * const *argv)
+  {
+  *state = NULL;
+  return TRUE;
+  }
+
+/*============================================================================
+
+  blank_render_frame
+
+  The canvas is already black, so it only needs to be copied.
+
+  ==========================================================================*/
+static int blank_render_frame (void *state, BitmapRGB *canvas, int dt_ms,
+       SaverDamage *damage)
+  {
+  saver_damage_add (damage, 0, 0, bitmaprgb_get_width (canvas),
+    bitmaprgb_get_height (canvas));
+  return -1;
+  }
+
+/*============================================================================
+
+  blank_stop
+
+  ==========================================================================*/
+static void blank_stop (void *state)
+  {
+  }
+
+const SaverBuiltin saver_builtin_blank =
+  {
+  "blank",
+  blank_init,
+  blank_render_frame,
+  blank_stop
+  };
+
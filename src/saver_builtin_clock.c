@@ -0,0 +1,246 @@
+/*============================================================================
+
+  console-idle
+
+  saver_builtin_clock.c
+
+  A built-in screen-saver that shows the time in large characters, with
+  the date and some information about the system below it. It takes
+  one optional argument: a PSF font file to use. Without it, the font
+  that the console was using is used.
+
+  The text is drawn with a GlyphCache, so each character is just a
+  bitmap copy. The text of each line is remembered from one frame to
+  the next, and only the characters that have changed are redrawn and
+  copied to the screen -- usually just the last digit or two of the
+  time. A frame is drawn just after each change of second, and
+  nothing at all is done in between.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/sysinfo.h>
+#include <klib/klib.h>
+#include "saver_builtin.h"
+#include "glyph_cache.h"
+
+#define KLOG_CLASS "console_idle.saver_builtin_clock"
+
+#define CLOCK_LINE_MAX 80
+
+// The lines of text, from top to bottom
+enum { LINE_TIME, LINE_DATE, LINE_HOST, LINE_LOAD, LINE_UPTIME, NLINES };
+
+typedef struct _ClockLine
+  {
+  GlyphCache *glyphs; // Not owned by this structure
+  int y;
+  int x; // Where the text currently on the canvas starts
+  int len; // Length of the text currently on the canvas
+  char text[CLOCK_LINE_MAX];
+  } ClockLine;
+
+typedef struct _ClockState
+  {
+  PsfFont *own_font; // NULL if the console font is used
+  GlyphCache *big;
+  GlyphCache *small;
+  int width;
+  ClockLine lines[NLINES];
+  } ClockState;
+
+/*============================================================================
+
+  clock_init
+
+  ==========================================================================*/
+static BOOL clock_init (void **state, BitmapRGB *canvas,
+       const SaverEnv *env, int argc, char * const *argv)
+  {
+  PsfFont *own_font = NULL;
+  const PsfFont *font = env->console_font;
+  if (argc > 1)
+    {
+    char *error = NULL;
+    own_font = psf_font_load (argv[1], &error);
+    if (!own_font)
+      {
+      klog_error (KLOG_CLASS, "%s", error);
+      free (error);
+      return FALSE;
+      }
+    font = own_font;
+    }
+  if (!font)
+    {
+    klog_error (KLOG_CLASS, "No font available -- specify a PSF file");
+    return FALSE;
+    }
+
+  int w = bitmaprgb_get_width (canvas);
+  int h = bitmaprgb_get_height (canvas);
+  int font_w = psf_font_get_width (font);
+  int font_h = psf_font_get_height (font);
+
+  // The time, HH:MM:SS, fills about 80% of the width, but no more
+  //  than a third of the height
+  int big_scale = (w * 8 / 10) / (8 * font_w);
+  if (big_scale * font_h > h / 3) big_scale = h / 3 / font_h;
+  if (big_scale < 1) big_scale = 1;
+  int small_scale = big_scale / 4;
+  if (small_scale < 1) small_scale = 1;
+
+  ClockState *self = malloc (sizeof (ClockState));
+  self->own_font = own_font;
+  self->big = glyph_cache_create (font, big_scale, 255, 255, 255, 0, 0, 0);
+  self->small = glyph_cache_create (font, small_scale,
+    160, 160, 160, 0, 0, 0);
+  self->width = w;
+
+  int big_h = glyph_cache_get_cell_height (self->big);
+  int small_h = glyph_cache_get_cell_height (self->small);
+  int line_h = small_h * 3 / 2;
+  int y = (h - big_h - small_h - line_h * (NLINES - 1)) / 2;
+  for (int i = 0; i < NLINES; i++)
+    {
+    ClockLine *line = &self->lines[i];
+    line->glyphs = i == LINE_TIME ? self->big : self->small;
+    line->y = y;
+    line->x = 0;
+    line->len = 0;
+    y += i == LINE_TIME ? big_h + small_h : line_h;
+    }
+
+  *state = self;
+  return TRUE;
+  }
+
+/*============================================================================
+
+  clock_draw_line
+
+  Change the text of a line, redrawing only the characters that differ
+  from what is on the canvas already. The text is centred, so if its
+  length changes, the whole line has to be redrawn. The canvas keeps
+  track of what has been redrawn.
+
+  ==========================================================================*/
+static void clock_draw_line (ClockState *self, ClockLine *line,
+       const char *text, BitmapRGB *canvas)
+  {
+  int cell_w = glyph_cache_get_cell_width (line->glyphs);
+  int cell_h = glyph_cache_get_cell_height (line->glyphs);
+  int len = strlen (text);
+  if (len > CLOCK_LINE_MAX - 1) len = CLOCK_LINE_MAX - 1;
+  if (len > self->width / cell_w) len = self->width / cell_w;
+  int x = (self->width - len * cell_w) / 2;
+
+  int first, last; // Range of characters to draw
+  if (len == line->len && x == line->x)
+    {
+    first = 0;
+    while (first < len && text[first] == line->text[first]) first++;
+    if (first == len) return;
+    last = len - 1;
+    while (text[last] == line->text[last]) last--;
+    }
+  else
+    {
+    // Clear whatever part of the old text won't be overwritten
+    int old_x2 = line->x + line->len * cell_w;
+    bitmaprgb_fill_rect (canvas, line->x, line->y, old_x2,
+      line->y + cell_h, 0, 0, 0);
+    first = 0;
+    last = len - 1;
+    }
+
+  for (int i = first; i <= last; i++)
+    {
+    const BitmapRGB *glyph = glyph_cache_get (line->glyphs,
+      (unsigned char)text[i]);
+    if (glyph) bitmaprgb_blit (canvas, glyph, x + i * cell_w, line->y);
+    }
+
+  memcpy (line->text, text, len);
+  line->text[len] = 0;
+  line->len = len;
+  line->x = x;
+  }
+
+/*============================================================================
+
+  clock_render_frame
+
+  ==========================================================================*/
+static int clock_render_frame (void *state, BitmapRGB *canvas, int dt_ms,
+       SaverDamage *damage)
+  {
+  ClockState *self = state;
+  char text[CLOCK_LINE_MAX];
+
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  struct tm tm;
+  localtime_r (&ts.tv_sec, &tm);
+
+  strftime (text, sizeof (text), "%H:%M:%S", &tm);
+  clock_draw_line (self, &self->lines[LINE_TIME], text, canvas);
+  strftime (text, sizeof (text), "%A %e %B %Y", &tm);
+  clock_draw_line (self, &self->lines[LINE_DATE], text, canvas);
+
+  if (gethostname (text, sizeof (text)) != 0) text[0] = 0;
+  text[sizeof (text) - 1] = 0;
+  clock_draw_line (self, &self->lines[LINE_HOST], text, canvas);
+
+  double load[3];
+  if (getloadavg (load, 3) == 3)
+    snprintf (text, sizeof (text), "load %.2f %.2f %.2f",
+      load[0], load[1], load[2]);
+  else
+    text[0] = 0;
+  clock_draw_line (self, &self->lines[LINE_LOAD], text, canvas);
+
+  struct sysinfo si;
+  if (sysinfo (&si) == 0)
+    {
+    long mins = si.uptime / 60;
+    snprintf (text, sizeof (text), "up %ld days, %02ld:%02ld",
+      mins / 1440, mins / 60 % 24, mins % 60);
+    }
+  else
+    text[0] = 0;
+  clock_draw_line (self, &self->lines[LINE_UPTIME], text, canvas);
+
+  // Wake up just after the start of the next second
+  return 1000 - (int)(ts.tv_nsec / 1000000) + 1;
+  }
+
+/*============================================================================
+
+  clock_stop
+
+  ==========================================================================*/
+static void clock_stop (void *state)
+  {
+  ClockState *self = state;
+  glyph_cache_destroy (self->big);
+  glyph_cache_destroy (self->small);
+  psf_font_destroy (self->own_font);
+  free (self);
+  }
+
+const SaverBuiltin saver_builtin_clock =
+  {
+  "clock",
+  clock_init,
+  clock_render_frame,
+  clock_stop
+  };
+
@@ -0,0 +1,105 @@
+/*============================================================================
+
+  console-idle
+
+  saver_builtin_fade.c
+
+  A built-in screen-saver that fades the screen contents gradually to
+  black. It takes one optional argument: the time taken to fade, in
+  seconds. Each frame is computed afresh from the snapshot, so rounding
+  errors don't accumulate, and when the screen is fully black no more
+  frames are drawn.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <klib/klib.h>
+#include "saver_builtin.h"
+
+#define KLOG_CLASS "console_idle.saver_builtin_fade"
+
+#define DEFAULT_FADE_SECS 10
+#define FRAME_MS 50
+
+typedef struct _FadeState
+  {
+  const BitmapRGB *snapshot;
+  int fade_ms; // Time to fade to black
+  int elapsed_ms;
+  } FadeState;
+
+/*============================================================================
+
+  fade_init
+
+  ==========================================================================*/
+static BOOL fade_init (void **state, BitmapRGB *canvas,
+       const SaverEnv *env, int argc, char * const *argv)
+  {
+  FadeState *self = malloc (sizeof (FadeState));
+  self->fade_ms = DEFAULT_FADE_SECS * 1000;
+  if (argc > 1 && atoi (argv[1]) > 0)
+    self->fade_ms = atoi (argv[1]) * 1000;
+  self->elapsed_ms = 0;
+
+  // Without a snapshot of the right size, there's nothing to fade
+  const BitmapRGB *snapshot = env->snapshot;
+  self->snapshot = NULL;
+  if (snapshot && bitmaprgb_get_width (snapshot) ==
+        bitmaprgb_get_width (canvas) && bitmaprgb_get_height (snapshot) ==
+        bitmaprgb_get_height (canvas))
+    self->snapshot = snapshot;
+  else
+    klog_warn (KLOG_CLASS, "No usable snapshot -- screen will be blank");
+
+  *state = self;
+  return TRUE;
+  }
+
+/*============================================================================
+
+  fade_render_frame
+
+  ==========================================================================*/
+static int fade_render_frame (void *state, BitmapRGB *canvas, int dt_ms,
+       SaverDamage *damage)
+  {
+  FadeState *self = state;
+  self->elapsed_ms += dt_ms;
+
+  int percent = 0;
+  if (self->snapshot && self->elapsed_ms < self->fade_ms)
+    percent = 100 - (int)((int64_t)self->elapsed_ms * 100 / self->fade_ms);
+
+  if (percent > 0)
+    {
+    bitmaprgb_copy_from (canvas, self->snapshot);
+    bitmaprgb_darken (canvas, percent);
+    }
+  else
+    bitmaprgb_darken (canvas, 0);
+
+  return percent > 0 ? FRAME_MS : -1;
+  }
+
+/*============================================================================
+
+  fade_stop
+
+  ==========================================================================*/
+static void fade_stop (void *state)
+  {
+  free (state);
+  }
+
+const SaverBuiltin saver_builtin_fade =
+  {
+  "fade",
+  fade_init,
+  fade_render_frame,
+  fade_stop
+  };
+
@@ -0,0 +1,237 @@
+/*============================================================================
+
+  console-idle
+
+  saver_builtin_slideshow.c
+
+  A built-in screen-saver that shows a sequence of images, each scaled
+  to fit the screen. Its arguments are an optional number of seconds
+  to show each image for, and then any number of image files or
+  directories; the images in a directory are shown in order of name.
+
+  Images are loaded by a SlideCache on a background thread. As soon as
+  one image is on the screen, the next is requested, so by the time it
+  is due it is usually ready, and changing images is a single copy --
+  to the frame, if the engine provides one, since the images are then
+  converted to the framebuffer's format when they are loaded.
+  If it is not ready, the current image just stays on the screen a
+  little longer.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <klib/klib.h>
+#include "saver_builtin.h"
+#include "slide_cache.h"
+
+#define KLOG_CLASS "console_idle.saver_builtin_slideshow"
+
+#define DEFAULT_SLIDE_SECS 10
+// How often to check whether an image that is late has loaded
+#define POLL_MS 50
+// Memory that loaded images may use
+#define SLIDESHOW_BUDGET (64 * 1024 * 1024)
+
+typedef struct _SlideshowState
+  {
+  SlideCache *cache;
+  BitmapFB *frame; // Drawn on instead of the canvas, if not NULL
+  int nfiles;
+  int current;
+  int interval_ms;
+  BOOL shown; // TRUE when the current image is on the canvas
+  int elapsed_ms; // Time the current image has been shown
+  } SlideshowState;
+
+/*============================================================================
+
+  slideshow_compare
+
+  ==========================================================================*/
+static int slideshow_compare (const void *a, const void *b)
+  {
+  return strcmp (*(char * const *)a, *(char * const *)b);
+  }
+
+/*============================================================================
+
+  slideshow_add_path
+
+  Add a file, or the files in a directory, to a list
+
+  ==========================================================================*/
+static void slideshow_add_path (const char *path, char ***files, int *nfiles)
+  {
+  struct stat sb;
+  if (stat (path, &sb) != 0)
+    {
+    klog_warn (KLOG_CLASS, "Can't find %s", path);
+    return;
+    }
+  if (S_ISDIR (sb.st_mode))
+    {
+    DIR *d = opendir (path);
+    if (!d)
+      {
+      klog_warn (KLOG_CLASS, "Can't open directory %s", path);
+      return;
+      }
+    int first = *nfiles;
+    struct dirent *de;
+    while ((de = readdir (d)))
+      {
+      if (de->d_name[0] == '.') continue;
+      char *file;
+      asprintf (&file, "%s/%s", path, de->d_name);
+      if (stat (file, &sb) == 0 && S_ISREG (sb.st_mode))
+        {
+        *files = realloc (*files, (*nfiles + 1) * sizeof (char *));
+        (*files)[(*nfiles)++] = file;
+        }
+      else
+        free (file);
+      }
+    closedir (d);
+    qsort (*files + first, *nfiles - first, sizeof (char *),
+      slideshow_compare);
+    }
+  else
+    {
+    *files = realloc (*files, (*nfiles + 1) * sizeof (char *));
+    (*files)[(*nfiles)++] = strdup (path);
+    }
+  }
+
+/*============================================================================
+
+  slideshow_init
+
+  ==========================================================================*/
+static BOOL slideshow_init (void **state, BitmapRGB *canvas,
+       const SaverEnv *env, int argc, char * const *argv)
+  {
+  int interval_secs = DEFAULT_SLIDE_SECS;
+  int arg = 1;
+  if (arg < argc && isdigit ((unsigned char)argv[arg][0]) &&
+       strspn (argv[arg], "0123456789") == strlen (argv[arg]))
+    {
+    if (atoi (argv[arg]) > 0) interval_secs = atoi (argv[arg]);
+    arg++;
+    }
+
+  char **files = NULL;
+  int nfiles = 0;
+  for (; arg < argc; arg++)
+    slideshow_add_path (argv[arg], &files, &nfiles);
+
+  SlideCache *cache = NULL;
+  if (nfiles > 0)
+    cache = slide_cache_create (nfiles, files,
+      bitmaprgb_get_width (canvas), bitmaprgb_get_height (canvas),
+      env->frame ? bitmapfb_get_bits_per_pixel (env->frame) : 0,
+      env->dither, env->pool, SLIDESHOW_BUDGET);
+  else
+    klog_error (KLOG_CLASS, "No image files specified");
+
+  for (int i = 0; i < nfiles; i++) free (files[i]);
+  free (files);
+  if (!cache) return FALSE;
+
+  SlideshowState *self = malloc (sizeof (SlideshowState));
+  self->cache = cache;
+  self->frame = env->frame;
+  self->nfiles = nfiles;
+  self->current = 0;
+  self->interval_ms = interval_secs * 1000;
+  self->shown = FALSE;
+  self->elapsed_ms = 0;
+
+  slide_cache_request (cache, 0);
+  if (nfiles > 1) slide_cache_request (cache, 1);
+
+  *state = self;
+  return TRUE;
+  }
+
+/*============================================================================
+
+  slideshow_render_frame
+
+  ==========================================================================*/
+static int slideshow_render_frame (void *state, BitmapRGB *canvas,
+       int dt_ms, SaverDamage *damage)
+  {
+  SlideshowState *self = state;
+  if (self->shown)
+    {
+    self->elapsed_ms += dt_ms;
+    if (self->elapsed_ms < self->interval_ms)
+      return self->interval_ms - self->elapsed_ms;
+    // Only move on if there's another image to show
+    if (self->nfiles == 1) return -1;
+    self->current = (self->current + 1) % self->nfiles;
+    self->shown = FALSE;
+    }
+
+  // Skip any images that can't be loaded
+  for (int tries = 0; tries < self->nfiles; tries++)
+    {
+    BOOL copied;
+    if (self->frame)
+      {
+      copied = slide_cache_copy_frame (self->cache, self->current, 
+        self->frame);
+      if (copied)
+        saver_damage_add_frame (damage, 0, 0, bitmaprgb_get_width (canvas),
+          bitmaprgb_get_height (canvas));
+      }
+    else
+      copied = slide_cache_copy (self->cache, self->current, canvas);
+    if (copied)
+      {
+      self->shown = TRUE;
+      self->elapsed_ms = 0;
+      slide_cache_request (self->cache, (self->current + 1) % self->nfiles);
+      return self->interval_ms;
+      }
+    if (slide_cache_get_state (self->cache, self->current) != SLIDE_FAILED)
+      {
+      // Not loaded yet, or discarded since it was requested
+      slide_cache_request (self->cache, self->current);
+      return POLL_MS;
+      }
+    self->current = (self->current + 1) % self->nfiles;
+    }
+
+  klog_error (KLOG_CLASS, "None of the images could be loaded");
+  return -1;
+  }
+
+/*============================================================================
+
+  slideshow_stop
+
+  ==========================================================================*/
+static void slideshow_stop (void *state)
+  {
+  SlideshowState *self = state;
+  slide_cache_destroy (self->cache);
+  free (self);
+  }
+
+const SaverBuiltin saver_builtin_slideshow =
+  {
+  "slideshow",
+  slideshow_init,
+  slideshow_render_frame,
+  slideshow_stop
+  };
+
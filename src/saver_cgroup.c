@@ -0,0 +1,381 @@
+/*============================================================================
+
+  console-idle
+
+  saver_cgroup.c
+
+  The cgroup is created at SAVER_CGROUP_DEFAULT_PATH, that is, 
+  directly below the root of the cgroup hierarchy, unless a specific
+  path is given. For limits to have any
+  effect, the relevant controllers must be enabled in the parent
+  cgroup's cgroup.subtree_control file -- this implementation tries to
+  enable the ones it needs.
+
+  CPU figures come from cpu.stat, which is cumulative over the life of
+  the cgroup; this class remembers the last figures it saw, and reports
+  the difference. Memory is reported from memory.peak, where the kernel
+  has it (Linux 5.19 and later), and not at all otherwise: the report
+  comes after the screen-saver has exited, when memory.current has
+  nothing left to show. The peak is also over the life of the cgroup,
+  but from Linux 6.12, writing to memory.peak resets it -- as seen
+  through the same file descriptor -- so the file is kept open, and
+  reset after each report. On kernels that can't reset it, the figure
+  is labelled as the peak since the cgroup was created, since that is
+  what it is.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <klib/klib.h>
+#include "saver_cgroup.h"
+
+#define KLOG_CLASS "console_idle.saver_cgroup"
+
+struct _SaverCgroup
+  {
+  char *path;
+  char *cpu_max;
+  char *memory_max;
+  char *io_max;
+  int procs_fd; // cgroup.procs, open for writing, or -1
+  int peak_fd; // memory.peak, or -1
+  BOOL peak_resets; // TRUE if memory.peak was reset after the last run
+  BOOL created; // TRUE if we created the directory, and should remove it
+  uint64_t last_usage_usec; // cpu.stat figures at the last report
+  uint64_t last_user_usec;
+  uint64_t last_system_usec;
+  uint64_t last_throttled_usec;
+  };
+
+/*============================================================================
+
+  saver_cgroup_create
+
+  ==========================================================================*/
+SaverCgroup *saver_cgroup_create (const char *path, const char *cpu_max,
+                  const char *memory_max, const char *io_max)
+  {
+  KLOG_IN
+  SaverCgroup *self = malloc (sizeof (SaverCgroup));
+  memset (self, 0, sizeof (SaverCgroup));
+  self->path = strdup (path ? path : SAVER_CGROUP_DEFAULT_PATH);
+  if (cpu_max) self->cpu_max = strdup (cpu_max);
+  if (memory_max) self->memory_max = strdup (memory_max);
+  if (io_max) self->io_max = strdup (io_max);
+  self->procs_fd = -1;
+  self->peak_fd = -1;
+  KLOG_OUT
+  return self;
+  }
+
+/*============================================================================
+
+  saver_cgroup_destroy
+
+  ==========================================================================*/
+void saver_cgroup_destroy (SaverCgroup *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    if (self->procs_fd >= 0) close (self->procs_fd);
+    if (self->peak_fd >= 0) close (self->peak_fd);
+    if (self->created && rmdir (self->path) != 0)
+      klog_debug (KLOG_CLASS, "Can't remove %s: %s", self->path,
+        strerror (errno));
+    free (self->path);
+    if (self->cpu_max) free (self->cpu_max);
+    if (self->memory_max) free (self->memory_max);
+    if (self->io_max) free (self->io_max);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_cgroup_write_file
+
+  Write a string to a control file in the specified directory.
+
+  ==========================================================================*/
+static BOOL saver_cgroup_write_file (const char *dir, const char *file,
+       const char *value)
+  {
+  BOOL ret = FALSE;
+  char *path;
+  asprintf (&path, "%s/%s", dir, file);
+  int fd = open (path, O_WRONLY | O_CLOEXEC);
+  if (fd >= 0)
+    {
+    if (write (fd, value, strlen (value)) >= 0)
+      ret = TRUE;
+    close (fd);
+    }
+  if (!ret)
+    klog_warn (KLOG_CLASS, "Can't write '%s' to %s: %s", value, path,
+      strerror (errno));
+  free (path);
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_cgroup_read_file
+
+  Read a (small) control file in the cgroup into a buffer, which is
+  always null-terminated. Returns FALSE if the file can't be read.
+
+  ==========================================================================*/
+static BOOL saver_cgroup_read_file (const SaverCgroup *self,
+       const char *file, char *buff, int len)
+  {
+  BOOL ret = FALSE;
+  char *path;
+  asprintf (&path, "%s/%s", self->path, file);
+  int fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd >= 0)
+    {
+    int n = read (fd, buff, len - 1);
+    if (n >= 0)
+      {
+      buff[n] = 0;
+      ret = TRUE;
+      }
+    close (fd);
+    }
+  free (path);
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_cgroup_enable_controller
+
+  ==========================================================================*/
+static void saver_cgroup_enable_controller (const SaverCgroup *self,
+       const char *controller)
+  {
+  char *parent = strdup (self->path);
+  char *slash = strrchr (parent, '/');
+  if (slash && slash != parent)
+    {
+    *slash = 0;
+    char *value;
+    asprintf (&value, "+%s", controller);
+    saver_cgroup_write_file (parent, "cgroup.subtree_control", value);
+    free (value);
+    }
+  free (parent);
+  }
+
+/*============================================================================
+
+  saver_cgroup_get_stat
+
+  Get a named value from the contents of cpu.stat
+
+  ==========================================================================*/
+static uint64_t saver_cgroup_get_stat (const char *stat, const char *name)
+  {
+  int l = strlen (name);
+  const char *p = stat;
+  while (p && *p)
+    {
+    if (strncmp (p, name, l) == 0 && p[l] == ' ')
+      return strtoull (p + l + 1, NULL, 10);
+    p = strchr (p, '\n');
+    if (p) p++;
+    }
+  return 0;
+  }
+
+/*============================================================================
+
+  saver_cgroup_sample_cpu
+
+  Read cpu.stat and, if log is TRUE, report the usage since the last
+  sample.
+
+  ==========================================================================*/
+static void saver_cgroup_sample_cpu (SaverCgroup *self, BOOL log)
+  {
+  char stat[1024];
+  if (saver_cgroup_read_file (self, "cpu.stat", stat, sizeof (stat)))
+    {
+    uint64_t usage = saver_cgroup_get_stat (stat, "usage_usec");
+    uint64_t user = saver_cgroup_get_stat (stat, "user_usec");
+    uint64_t system = saver_cgroup_get_stat (stat, "system_usec");
+    uint64_t throttled = saver_cgroup_get_stat (stat, "throttled_usec");
+
+    if (log)
+      {
+      klog_info (KLOG_CLASS, "Screen-saver CPU: %.2fs total, %.2fs user, "
+        "%.2fs system, %.2fs throttled",
+        (usage - self->last_usage_usec) / 1e6,
+        (user - self->last_user_usec) / 1e6,
+        (system - self->last_system_usec) / 1e6,
+        (throttled - self->last_throttled_usec) / 1e6);
+      }
+
+    self->last_usage_usec = usage;
+    self->last_user_usec = user;
+    self->last_system_usec = system;
+    self->last_throttled_usec = throttled;
+    }
+  }
+
+/*============================================================================
+
+  saver_cgroup_reset_peak
+
+  Open memory.peak, if it is not already open, and try to reset it, so
+  that the next reading is the peak from now on.
+
+  ==========================================================================*/
+static void saver_cgroup_reset_peak (SaverCgroup *self)
+  {
+  if (self->peak_fd < 0)
+    {
+    char *path;
+    asprintf (&path, "%s/memory.peak", self->path);
+    self->peak_fd = open (path, O_RDWR | O_CLOEXEC);
+    if (self->peak_fd < 0)
+      self->peak_fd = open (path, O_RDONLY | O_CLOEXEC);
+    free (path);
+    }
+  self->peak_resets = self->peak_fd >= 0 &&
+    write (self->peak_fd, "reset\n", 6) > 0;
+  }
+
+/*============================================================================
+
+  saver_cgroup_init
+
+  ==========================================================================*/
+BOOL saver_cgroup_init (SaverCgroup *self, char **error)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+
+  klog_debug (KLOG_CLASS, "Setting up cgroup %s", self->path);
+
+  if (mkdir (self->path, 0755) == 0)
+    self->created = TRUE;
+
+  if (self->created || errno == EEXIST)
+    {
+    // Controllers have to be enabled in the parent before we can set
+    //   limits in the child
+    if (self->cpu_max)
+      {
+      saver_cgroup_enable_controller (self, "cpu");
+      saver_cgroup_write_file (self->path, "cpu.max", self->cpu_max);
+      }
+    if (self->memory_max)
+      {
+      saver_cgroup_enable_controller (self, "memory");
+      saver_cgroup_write_file (self->path, "memory.max", self->memory_max);
+      }
+    if (self->io_max)
+      {
+      saver_cgroup_enable_controller (self, "io");
+      saver_cgroup_write_file (self->path, "io.max", self->io_max);
+      }
+
+    char *procs;
+    asprintf (&procs, "%s/cgroup.procs", self->path);
+    self->procs_fd = open (procs, O_WRONLY | O_CLOEXEC);
+    if (self->procs_fd >= 0)
+      {
+      ret = TRUE;
+      // Start counting from here, in case the cgroup was already in use
+      saver_cgroup_sample_cpu (self, FALSE);
+      saver_cgroup_reset_peak (self);
+      }
+    else
+      {
+      if (error)
+        asprintf (error, "Can't open %s: %s", procs, strerror (errno));
+      }
+    free (procs);
+    }
+  else
+    {
+    if (error)
+      asprintf (error, "Can't create cgroup %s: %s", self->path,
+        strerror (errno));
+    }
+
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_cgroup_get_procs_fd
+
+  ==========================================================================*/
+int saver_cgroup_get_procs_fd (const SaverCgroup *self)
+  {
+  return self->procs_fd;
+  }
+
+/*============================================================================
+
+  saver_cgroup_kill
+
+  ==========================================================================*/
+BOOL saver_cgroup_kill (SaverCgroup *self)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  char *path;
+  asprintf (&path, "%s/cgroup.kill", self->path);
+  int fd = open (path, O_WRONLY | O_CLOEXEC);
+  if (fd >= 0)
+    {
+    if (write (fd, "1", 1) == 1)
+      ret = TRUE;
+    close (fd);
+    }
+  free (path);
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_cgroup_report
+
+  ==========================================================================*/
+void saver_cgroup_report (SaverCgroup *self)
+  {
+  KLOG_IN
+  saver_cgroup_sample_cpu (self, TRUE);
+
+  char mem[64];
+  int n = self->peak_fd >= 0 ?
+    pread (self->peak_fd, mem, sizeof (mem) - 1, 0) : -1;
+  if (n >= 0)
+    {
+    mem[n] = 0;
+    klog_info (KLOG_CLASS, "Screen-saver memory: %" PRIu64 " kB peak%s",
+      (uint64_t)strtoull (mem, NULL, 10) / 1024,
+      self->peak_resets ? "" : " since the cgroup was created");
+    saver_cgroup_reset_peak (self);
+    }
+  KLOG_OUT
+  }
+
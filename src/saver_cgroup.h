@@ -0,0 +1,68 @@
+/*============================================================================
+
+  console-idle
+
+  saver_cgroup.h
+
+  A "class" that manages a cgroup (version 2) for the screen-saver
+  program, so that its use of CPU, memory, and I/O can be limited and
+  measured. The usual sequence of operations is
+
+  saver_cgroup_create
+  saver_cgroup_init (creates the cgroup, and applies the limits)
+  saver_cgroup_get_procs_fd (the child writes "0" to this to join)
+  saver_cgroup_report (after each run of the screen-saver)
+  saver_cgroup_destroy (removes the cgroup, if it is empty)
+
+  Limits are written to the cgroup's control files exactly as supplied,
+  so they must be in the format the kernel expects -- for example,
+  "50000 100000" for cpu.max, or "64M" for memory.max.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+
+// Where the cgroup is created, if the user does not say
+#define SAVER_CGROUP_DEFAULT_PATH "/sys/fs/cgroup/console-idle"
+
+struct _SaverCgroup;
+typedef struct _SaverCgroup SaverCgroup;
+
+BEGIN_DECLS
+
+/** Create a new SaverCgroup object. Any of the limits may be NULL,
+    in which case the kernel's default (usually "max") applies. This
+    method always succeeds, and does not touch the cgroup filesystem. */
+SaverCgroup   *saver_cgroup_create (const char *path, const char *cpu_max,
+                  const char *memory_max, const char *io_max);
+
+/** Remove the cgroup, if possible, and free memory. */
+void           saver_cgroup_destroy (SaverCgroup *self);
+
+/** Create the cgroup directory, enable the controllers that the limits
+    need, and write the limits. If this method fails, error is set, and
+    must be freed by the caller. A failure to apply a particular limit
+    is logged, but is not treated as an error. */
+BOOL           saver_cgroup_init (SaverCgroup *self, char **error);
+
+/** Get a file descriptor open for writing on the cgroup's cgroup.procs
+    file. A process joins the cgroup by writing "0" to it. The
+    descriptor is close-on-exec. */
+int            saver_cgroup_get_procs_fd (const SaverCgroup *self);
+
+/** Kill every process in the cgroup. Returns FALSE if the kernel does
+    not support this (it needs Linux 5.14 or later). */
+BOOL           saver_cgroup_kill (SaverCgroup *self);
+
+/** Log the CPU time and the peak memory used by the cgroup since the
+    last call to this method. On kernels before Linux 6.12, the peak
+    can't be reset, so is the peak since the cgroup was set up; before
+    Linux 5.19, there is no peak, and only CPU time is logged. */
+void           saver_cgroup_report (SaverCgroup *self);
+
+END_DECLS
+
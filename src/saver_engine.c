@@ -0,0 +1,407 @@
+/*============================================================================
+
+  console-idle
+
+  saver_engine.c
+
+  Each frame says when the next one is due, measured from the time
+  that the frame itself was due. So if a frame is drawn late, the
+  next one is still drawn at its proper time; but if a whole frame
+  interval has been missed, the schedule is moved on, rather than
+  drawing several frames to catch up. Each frame is told the actual
+  time since the last one, so animation speed does not depend on the
+  frame rate.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <klib/klib.h>
+#include "monotime.h"
+#include "saver_engine.h"
+
+#define KLOG_CLASS "console_idle.saver_engine"
+
+static const SaverBuiltin *saver_engine_builtins[] =
+  {
+  &saver_builtin_blank,
+  &saver_builtin_fade,
+  &saver_builtin_clock,
+  &saver_builtin_slideshow,
+  NULL
+  };
+
+struct _SaverEngine
+  {
+  FrameBuffer *fb; // Not owned by this object
+  PsfFont *console_font; // NULL if the console font could not be read
+  const SaverBuiltin *builtin; // NULL when nothing is running
+  void *state; // Belongs to the built-in screen-saver
+  BitmapRGB *canvas;
+  BitmapRGBTransform transform; // From the canvas to the framebuffer
+  BitmapRGBDither dither; // For framebuffers of less than 24 bpp
+  BitmapRGB *snapshot; // Turned to match the canvas, if it needs to be
+  BitmapFB *frame; // NULL unless the canvas is the right way up
+  int threads; // For the pool, or 0 for one for each CPU
+  KThreadPool *pool; // Only while a screen-saver is running
+  int64_t last_ms; // When the last frame was drawn, or zero if none
+  int64_t next_ms; // When the next frame is due, or zero if none is
+  };
+
+/*============================================================================
+
+  saver_engine_create
+
+  ==========================================================================*/
+SaverEngine *saver_engine_create (FrameBuffer *fb)
+  {
+  KLOG_IN
+  SaverEngine *self = malloc (sizeof (SaverEngine));
+  self->fb = fb;
+
+  // The console font can't be read once the console is in graphics
+  //  mode, so take a copy now
+  char *error = NULL;
+  self->console_font = psf_font_from_console ("/dev/tty0", &error);
+  if (!self->console_font)
+    {
+    klog_debug (KLOG_CLASS, "%s", error);
+    free (error);
+    }
+
+  self->builtin = NULL;
+  self->state = NULL;
+  self->canvas = NULL;
+  self->transform = BITMAPRGB_TRANSFORM_NONE;
+  self->dither = BITMAPRGB_DITHER_ORDERED;
+  self->snapshot = NULL;
+  self->frame = NULL;
+  self->threads = 0;
+  self->pool = NULL;
+  self->last_ms = 0;
+  self->next_ms = 0;
+  KLOG_OUT
+  return self;
+  }
+
+/*============================================================================
+
+  saver_engine_destroy
+
+  ==========================================================================*/
+void saver_engine_destroy (SaverEngine *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    saver_engine_stop (self);
+    psf_font_destroy (self->console_font);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_engine_set_transform
+
+  ==========================================================================*/
+void saver_engine_set_transform (SaverEngine *self,
+       BitmapRGBTransform transform)
+  {
+  self->transform = transform;
+  }
+
+/*============================================================================
+
+  saver_engine_set_dither
+
+  ==========================================================================*/
+void saver_engine_set_dither (SaverEngine *self, BitmapRGBDither dither)
+  {
+  self->dither = dither;
+  }
+
+/*============================================================================
+
+  saver_engine_set_threads
+
+  ==========================================================================*/
+void saver_engine_set_threads (SaverEngine *self, int threads)
+  {
+  self->threads = threads;
+  }
+
+/*============================================================================
+
+  saver_engine_is_builtin
+
+  ==========================================================================*/
+BOOL saver_engine_is_builtin (const char *command)
+  {
+  return strncmp (command, SAVER_BUILTIN_PREFIX,
+    strlen (SAVER_BUILTIN_PREFIX)) == 0;
+  }
+
+/*============================================================================
+
+  saver_engine_find
+
+  ==========================================================================*/
+static const SaverBuiltin *saver_engine_find (const char *name)
+  {
+  for (int i = 0; saver_engine_builtins[i]; i++)
+    {
+    if (strcmp (saver_engine_builtins[i]->name, name) == 0)
+      return saver_engine_builtins[i];
+    }
+  return NULL;
+  }
+
+/*============================================================================
+
+  saver_engine_start
+
+  ==========================================================================*/
+BOOL saver_engine_start (SaverEngine *self, int argc, char * const *argv,
+       const BitmapRGB *snapshot)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  saver_engine_stop (self);
+
+  const char *name = argv[0] + strlen (SAVER_BUILTIN_PREFIX);
+  const SaverBuiltin *builtin = saver_engine_find (name);
+  if (builtin)
+    {
+    char *error = NULL;
+    if (framebuffer_init (self->fb, &error))
+      {
+      int w = framebuffer_get_width (self->fb);
+      int h = framebuffer_get_height (self->fb);
+      BitmapRGBTransform inverse = self->transform;
+      if (self->transform == BITMAPRGB_TRANSFORM_ROTATE_90)
+        inverse = BITMAPRGB_TRANSFORM_ROTATE_270;
+      else if (self->transform == BITMAPRGB_TRANSFORM_ROTATE_270)
+        inverse = BITMAPRGB_TRANSFORM_ROTATE_90;
+      if (inverse != self->transform)
+        self->canvas = bitmaprgb_create (h, w);
+      else
+        self->canvas = bitmaprgb_create (w, h);
+      if (self->canvas)
+        {
+        bitmaprgb_track_damage (self->canvas, TRUE);
+
+        // The snapshot is of the framebuffer, so must be turned the 
+        //   other way to match the canvas. Without the memory for that,
+        //   the screen-saver runs as if there were no snapshot
+        if (snapshot && inverse != BITMAPRGB_TRANSFORM_NONE)
+          {
+          self->snapshot = bitmaprgb_transform (snapshot, inverse);
+          snapshot = self->snapshot;
+          }
+        // Without the memory for a frame, the canvas is drawn on instead
+        if (self->transform == BITMAPRGB_TRANSFORM_NONE)
+          {
+          self->frame = bitmapfb_create_for_fb (self->fb);
+          if (!self->frame)
+            klog_warn (KLOG_CLASS, "Not enough memory for a frame");
+          }
+        self->pool = kthreadpool_create (self->threads);
+        SaverEnv env;
+        env.snapshot = snapshot;
+        env.console_font = self->console_font;
+        env.frame = self->frame;
+        env.dither = self->dither;
+        env.pool = self->pool;
+        if (builtin->init (&self->state, self->canvas, &env, argc, argv))
+          {
+          klog_debug (KLOG_CLASS, "Started built-in screen-saver %s", name);
+          self->builtin = builtin;
+          self->last_ms = 0;
+          self->next_ms = monotime_ms();
+          ret = TRUE;
+          }
+        }
+      else
+        klog_error (KLOG_CLASS, "Not enough memory for a canvas");
+
+      if (!ret)
+        {
+        klog_error (KLOG_CLASS, "Can't start built-in screen-saver %s",
+          name);
+        bitmaprgb_destroy (self->canvas);
+        self->canvas = NULL;
+        bitmaprgb_destroy (self->snapshot);
+        self->snapshot = NULL;
+        bitmapfb_destroy (self->frame);
+        self->frame = NULL;
+        kthreadpool_destroy (self->pool);
+        self->pool = NULL;
+        framebuffer_deinit (self->fb);
+        }
+      }
+    else
+      {
+      klog_error (KLOG_CLASS, "%s", error);
+      free (error);
+      }
+    }
+  else
+    klog_error (KLOG_CLASS, "No built-in screen-saver called %s", name);
+
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_engine_stop
+
+  ==========================================================================*/
+void saver_engine_stop (SaverEngine *self)
+  {
+  KLOG_IN
+  if (self->builtin)
+    {
+    klog_debug (KLOG_CLASS, "Stopping built-in screen-saver %s",
+      self->builtin->name);
+    self->builtin->stop (self->state);
+    self->state = NULL;
+    self->builtin = NULL;
+    bitmaprgb_destroy (self->canvas);
+    self->canvas = NULL;
+    bitmaprgb_destroy (self->snapshot);
+    self->snapshot = NULL;
+    bitmapfb_destroy (self->frame);
+    self->frame = NULL;
+    kthreadpool_destroy (self->pool);
+    self->pool = NULL;
+    framebuffer_deinit (self->fb);
+    }
+  self->next_ms = 0;
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_engine_service
+
+  ==========================================================================*/
+void saver_engine_service (SaverEngine *self)
+  {
+  KLOG_IN
+  int64_t now = monotime_ms();
+  if (self->builtin && self->next_ms != 0 && now >= self->next_ms)
+    {
+    int dt_ms = self->last_ms ? (int)(now - self->last_ms) : 0;
+    SaverDamage damage;
+    damage.n = 0;
+    damage.n_frame = 0;
+    int next = self->builtin->render_frame (self->state, self->canvas,
+      dt_ms, &damage);
+    // The canvas records what was drawn on it; anything else the
+    //   screen-saver reports is added to that
+    for (int i = 0; i < damage.n; i++)
+      {
+      const SaverRect *r = &damage.rects[i];
+      bitmaprgb_add_damage (self->canvas, r->x, r->y, r->w, r->h);
+      }
+    bitmaprgb_present_transformed (self->canvas, self->fb, self->transform,
+      self->dither);
+    for (int i = 0; i < damage.n_frame && self->frame; i++)
+      {
+      const SaverRect *r = &damage.frame_rects[i];
+      bitmapfb_to_fb_rect (self->frame, self->fb, r->x, r->y, r->w, r->h);
+      }
+    self->last_ms = now;
+
+    if (next >= 0)
+      {
+      self->next_ms += next;
+      if (self->next_ms <= now)
+        self->next_ms = now + next;
+      }
+    else
+      self->next_ms = 0;
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_damage_add_to
+
+  Add a rectangle to a list of them, of SAVER_MAX_DAMAGE at most
+
+  ==========================================================================*/
+static void saver_damage_add_to (SaverRect *rects, int *n, 
+       int x, int y, int w, int h)
+  {
+  if (w <= 0 || h <= 0) return;
+  if (*n < SAVER_MAX_DAMAGE)
+    {
+    SaverRect *r = &rects[(*n)++];
+    r->x = x;
+    r->y = y;
+    r->w = w;
+    r->h = h;
+    }
+  else
+    {
+    SaverRect *r = &rects[SAVER_MAX_DAMAGE - 1];
+    int x2 = r->x + r->w > x + w ? r->x + r->w : x + w;
+    int y2 = r->y + r->h > y + h ? r->y + r->h : y + h;
+    if (x < r->x) r->x = x;
+    if (y < r->y) r->y = y;
+    r->w = x2 - r->x;
+    r->h = y2 - r->y;
+    }
+  }
+
+/*============================================================================
+
+  saver_damage_add
+
+  ==========================================================================*/
+void saver_damage_add (SaverDamage *damage, int x, int y, int w, int h)
+  {
+  saver_damage_add_to (damage->rects, &damage->n, x, y, w, h);
+  }
+
+/*============================================================================
+
+  saver_damage_add_frame
+
+  ==========================================================================*/
+void saver_damage_add_frame (SaverDamage *damage, int x, int y, 
+       int w, int h)
+  {
+  saver_damage_add_to (damage->frame_rects, &damage->n_frame, x, y, w, h);
+  }
+
+/*============================================================================
+
+  saver_engine_get_wait_ms
+
+  ==========================================================================*/
+int saver_engine_get_wait_ms (const SaverEngine *self)
+  {
+  if (!self->builtin || self->next_ms == 0) return -1;
+  return monotime_ms_until (self->next_ms);
+  }
+
+/*============================================================================
+
+  saver_engine_is_running
+
+  ==========================================================================*/
+BOOL saver_engine_is_running (const SaverEngine *self)
+  {
+  return self->builtin != NULL;
+  }
+
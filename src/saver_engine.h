@@ -0,0 +1,94 @@
+/*============================================================================
+
+  console-idle
+
+  saver_engine.h
+
+  A "class" that runs built-in screen-savers (see saver_builtin.h). The
+  usual sequence of operations is
+
+  saver_engine_create
+  saver_engine_start
+  saver_engine_service (whenever saver_engine_get_wait_ms() has passed)
+  saver_engine_stop
+  saver_engine_destroy
+
+  Frames are scheduled by the caller's event loop, in the same way as
+  SaverProcess supervision: the caller limits its poll() timeout using
+  saver_engine_get_wait_ms(), and calls saver_engine_service() after
+  every poll(). The framebuffer stays mapped while a screen-saver runs.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+#include "saver_builtin.h"
+
+// Screen-saver commands that start with this are built-in
+#define SAVER_BUILTIN_PREFIX "builtin:"
+
+struct _SaverEngine;
+typedef struct _SaverEngine SaverEngine;
+
+BEGIN_DECLS
+
+/** Create a new SaverEngine that draws on the specified framebuffer,
+    which it does not own. The framebuffer must not be initialized
+    while a screen-saver is running. This method also takes a copy
+    of the console font, for screen-savers that draw text, so it
+    should be called while the console is still in text mode. */
+SaverEngine   *saver_engine_create (FrameBuffer *fb);
+
+/** Set how the screen-savers' output is turned to fit the framebuffer,
+    for panels that are not mounted the usual way up. A rotation by 90
+    or 270 degrees gives screen-savers a canvas with the width and
+    height of the framebuffer swapped. Takes effect when the next
+    screen-saver starts. */
+void           saver_engine_set_transform (SaverEngine *self, 
+                  BitmapRGBTransform transform);
+
+/** Set how the screen-savers' output is reduced to the colours of a 
+    framebuffer with fewer than 24 bits per pixel. The default is 
+    ordered dithering. */
+void           saver_engine_set_dither (SaverEngine *self, 
+                  BitmapRGBDither dither);
+
+/** Set how many threads the screen-savers may use to draw, or 0 (the
+    default) for one for each CPU. With 1, everything is done on the
+    calling thread, in order. Takes effect when the next screen-saver
+    starts. */
+void           saver_engine_set_threads (SaverEngine *self, int threads);
+
+/** Destroy this object, stopping any screen-saver that is running. */
+void           saver_engine_destroy (SaverEngine *self);
+
+/** Returns TRUE if the command names a built-in screen-saver, whether
+    or not it actually exists. */
+BOOL           saver_engine_is_builtin (const char *command);
+
+/** Start the built-in screen-saver named by argv[0], which has the form
+    "builtin:name". snapshot may be NULL, but if it is not, it must
+    remain valid until the screen-saver stops. The first frame is
+    drawn by the next call to saver_engine_service(). Returns FALSE
+    if the screen-saver can't be started. */
+BOOL           saver_engine_start (SaverEngine *self, int argc,
+                  char * const *argv, const BitmapRGB *snapshot);
+
+/** Stop the screen-saver, if one is running. The screen is left as it
+    is. */
+void           saver_engine_stop (SaverEngine *self);
+
+/** Draw a frame, if one is due. This method never blocks. */
+void           saver_engine_service (SaverEngine *self);
+
+/** Get the time, in milliseconds, until the next frame is due, or -1 if
+    no more frames are due. */
+int            saver_engine_get_wait_ms (const SaverEngine *self);
+
+BOOL           saver_engine_is_running (const SaverEngine *self);
+
+END_DECLS
+
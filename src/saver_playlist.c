@@ -0,0 +1,323 @@
+/*============================================================================
+
+  console-idle
+
+  saver_playlist.c
+
+  Prefetching uses posix_fadvise() with POSIX_FADV_WILLNEED, which
+  starts asynchronous readahead and returns at once -- there's no need
+  for a thread of our own. Since the arguments to a screen-saver can
+  name a great many files (a slideshow of a photo collection, for
+  example), the total amount of data prefetched at one time is limited.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <klib/klib.h>
+#include "saver_playlist.h"
+
+#define KLOG_CLASS "console_idle.saver_playlist"
+
+// Most data that will be prefetched for one command
+#define PREFETCH_BUDGET (64 * 1024 * 1024)
+
+typedef struct _SaverPlaylistEntry
+  {
+  int argc;
+  char **argv; // NULL-terminated
+  } SaverPlaylistEntry;
+
+struct _SaverPlaylist
+  {
+  KList *entries;
+  int current;
+  };
+
+/*============================================================================
+
+  saver_playlist_entry_destroy
+
+  ==========================================================================*/
+static void saver_playlist_entry_destroy (void *p)
+  {
+  SaverPlaylistEntry *entry = p;
+  for (int i = 0; i < entry->argc; i++)
+    free (entry->argv[i]);
+  free (entry->argv);
+  free (entry);
+  }
+
+/*============================================================================
+
+  saver_playlist_create
+
+  ==========================================================================*/
+SaverPlaylist *saver_playlist_create (void)
+  {
+  KLOG_IN
+  SaverPlaylist *self = malloc (sizeof (SaverPlaylist));
+  self->entries = klist_new_empty (saver_playlist_entry_destroy);
+  self->current = 0;
+  KLOG_OUT
+  return self;
+  }
+
+/*============================================================================
+
+  saver_playlist_destroy
+
+  ==========================================================================*/
+void saver_playlist_destroy (SaverPlaylist *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    klist_destroy (self->entries);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_playlist_add_argv
+
+  ==========================================================================*/
+void saver_playlist_add_argv (SaverPlaylist *self, int argc,
+       char * const *argv)
+  {
+  KLOG_IN
+  SaverPlaylistEntry *entry = malloc (sizeof (SaverPlaylistEntry));
+  entry->argc = argc;
+  entry->argv = malloc ((argc + 1) * sizeof (char *));
+  for (int i = 0; i < argc; i++)
+    entry->argv[i] = strdup (argv[i]);
+  entry->argv[argc] = NULL;
+  klist_append (self->entries, entry);
+  klog_debug (KLOG_CLASS, "Added screen-saver command %s", argv[0]);
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_playlist_add_command
+
+  ==========================================================================*/
+BOOL saver_playlist_add_command (SaverPlaylist *self, const char *command)
+  {
+  KLOG_IN
+  int argc = 0;
+  int max_args = strlen (command) / 2 + 1;
+  char **argv = malloc (max_args * sizeof (char *));
+  // No argument can be longer than the whole command
+  char *arg = malloc (strlen (command) + 1);
+
+  const char *p = command;
+  while (*p)
+    {
+    while (isspace ((unsigned char)*p)) p++;
+    if (!*p) break;
+
+    int l = 0;
+    char quote = 0;
+    while (*p && (quote || !isspace ((unsigned char)*p)))
+      {
+      if (quote && *p == quote)
+        quote = 0;
+      else if (!quote && (*p == '"' || *p == '\''))
+        quote = *p;
+      else
+        arg[l++] = *p;
+      p++;
+      }
+    arg[l] = 0;
+    argv[argc++] = strdup (arg);
+    }
+
+  BOOL ret = (argc > 0);
+  if (ret)
+    saver_playlist_add_argv (self, argc, argv);
+
+  for (int i = 0; i < argc; i++)
+    free (argv[i]);
+  free (argv);
+  free (arg);
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_playlist_load
+
+  ==========================================================================*/
+BOOL saver_playlist_load (SaverPlaylist *self, const char *file,
+       char **error)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  FILE *f = fopen (file, "r");
+  if (f)
+    {
+    char *line = NULL;
+    size_t len = 0;
+    while (getline (&line, &len, f) > 0)
+      {
+      char *p = line;
+      while (isspace ((unsigned char)*p)) p++;
+      if (*p == '#') continue;
+      saver_playlist_add_command (self, p);
+      }
+    free (line);
+    fclose (f);
+    ret = TRUE;
+    }
+  else
+    {
+    if (error)
+      asprintf (error, "Can't open playlist %s: %s", file, strerror (errno));
+    }
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_playlist_get_length
+
+  ==========================================================================*/
+int saver_playlist_get_length (const SaverPlaylist *self)
+  {
+  return klist_length (self->entries);
+  }
+
+/*============================================================================
+
+  saver_playlist_get_current
+
+  ==========================================================================*/
+char * const *saver_playlist_get_current (const SaverPlaylist *self,
+       int *argc)
+  {
+  SaverPlaylistEntry *entry = klist_get (self->entries, self->current);
+  *argc = entry->argc;
+  return entry->argv;
+  }
+
+/*============================================================================
+
+  saver_playlist_advance
+
+  ==========================================================================*/
+void saver_playlist_advance (SaverPlaylist *self)
+  {
+  int length = saver_playlist_get_length (self);
+  if (length > 0)
+    self->current = (self->current + 1) % length;
+  }
+
+/*============================================================================
+
+  saver_playlist_prefetch_file
+
+  Start readahead on a file, if it is a regular file, and there's
+  enough budget left. Returns the number of bytes requested.
+
+  ==========================================================================*/
+static int64_t saver_playlist_prefetch_file (const char *file,
+       int64_t budget)
+  {
+  int64_t ret = 0;
+  int fd = open (file, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+  if (fd >= 0)
+    {
+    struct stat sb;
+    if (fstat (fd, &sb) == 0 && S_ISREG (sb.st_mode) &&
+          sb.st_size <= budget)
+      {
+      if (posix_fadvise (fd, 0, sb.st_size, POSIX_FADV_WILLNEED) == 0)
+        ret = sb.st_size;
+      }
+    close (fd);
+    }
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_playlist_find_program
+
+  Find the program file that execvp() would run, searching $PATH if
+  necessary. Returns NULL if it can't be found. The caller must free the
+  result.
+
+  ==========================================================================*/
+static char *saver_playlist_find_program (const char *name)
+  {
+  if (strchr (name, '/'))
+    return strdup (name);
+
+  const char *path = getenv ("PATH");
+  if (!path) path = "/bin:/usr/bin";
+
+  char *ret = NULL;
+  char *dirs = strdup (path);
+  char *saveptr = NULL;
+  for (char *dir = strtok_r (dirs, ":", &saveptr); dir && !ret;
+       dir = strtok_r (NULL, ":", &saveptr))
+    {
+    char *candidate;
+    asprintf (&candidate, "%s/%s", *dir ? dir : ".", name);
+    if (access (candidate, X_OK) == 0)
+      ret = candidate;
+    else
+      free (candidate);
+    }
+  free (dirs);
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_playlist_prefetch_next
+
+  ==========================================================================*/
+void saver_playlist_prefetch_next (const SaverPlaylist *self)
+  {
+  KLOG_IN
+  int length = saver_playlist_get_length (self);
+  if (length > 0)
+    {
+    SaverPlaylistEntry *entry = klist_get (self->entries,
+      (self->current + 1) % length);
+    int64_t budget = PREFETCH_BUDGET;
+
+    char *program = saver_playlist_find_program (entry->argv[0]);
+    if (program)
+      {
+      budget -= saver_playlist_prefetch_file (program, budget);
+      free (program);
+      }
+
+    for (int i = 1; i < entry->argc && budget > 0; i++)
+      {
+      if (entry->argv[i][0] != '-')
+        budget -= saver_playlist_prefetch_file (entry->argv[i], budget);
+      }
+
+    klog_debug (KLOG_CLASS, "Prefetched %ld bytes for %s",
+      (long)(PREFETCH_BUDGET - budget), entry->argv[0]);
+    }
+  KLOG_OUT
+  }
+
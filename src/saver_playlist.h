@@ -0,0 +1,61 @@
+/*============================================================================
+
+  console-idle
+
+  saver_playlist.h
+
+  A "class" that holds a list of screen-saver command lines, and keeps
+  track of which one is to be run next. Commands can be added as
+  argument arrays, as single strings to be split into arguments, or
+  from a file that contains one command per line.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+
+struct _SaverPlaylist;
+typedef struct _SaverPlaylist SaverPlaylist;
+
+BEGIN_DECLS
+
+SaverPlaylist *saver_playlist_create (void);
+void           saver_playlist_destroy (SaverPlaylist *self);
+
+/** Add a command, whose arguments are copied. */
+void           saver_playlist_add_argv (SaverPlaylist *self, int argc,
+                  char * const *argv);
+
+/** Add a command given as a single string. Arguments are separated by
+    whitespace, and may be enclosed in single or double quotes. Returns
+    FALSE if the string contains no command. */
+BOOL           saver_playlist_add_command (SaverPlaylist *self,
+                  const char *command);
+
+/** Add the commands in a file, one per line. Blank lines, and lines
+    that begin with '#', are ignored. If this method fails, error is
+    set, and must be freed by the caller. */
+BOOL           saver_playlist_load (SaverPlaylist *self, const char *file,
+                  char **error);
+
+int            saver_playlist_get_length (const SaverPlaylist *self);
+
+/** Get the command that should be run now. The argument array belongs
+    to the playlist, and is NULL-terminated. */
+char * const  *saver_playlist_get_current (const SaverPlaylist *self,
+                  int *argc);
+
+/** Move on to the next command in the list, going back to the start
+    after the last. */
+void           saver_playlist_advance (SaverPlaylist *self);
+
+/** Ask the kernel to start reading the next command's program file,
+    and any of its arguments that name regular files, into the page
+    cache. This method does not wait for the data to be read. */
+void           saver_playlist_prefetch_next (const SaverPlaylist *self);
+
+END_DECLS
+
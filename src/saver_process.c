@@ -0,0 +1,955 @@
+/*============================================================================
+
+  console-idle
+
+  saver_process.c
+
+  Pre-warming works by having the child ask to be traced before it calls
+  exec(). The kernel then stops the child with SIGTRAP as soon as the
+  new program image is in place, but before any of its code (including
+  the dynamic linker) has run. We detach from the child, leaving it with
+  a pending SIGSTOP, so it stays stopped as an ordinary job-controlled
+  process until we send SIGCONT. What is paid before the idle timeout
+  expires is therefore just the fork() and the exec() -- the kernel
+  mapping the executable and its interpreter. Everything after that
+  happens only after SIGCONT: the dynamic linker loading and relocating
+  shared libraries, and the program's own start-up, including paging in
+  whatever code and data it touches. For a large, dynamically-linked
+  program, that may well be most of its start-up time.
+
+  The child is created using clone() with CLONE_VM and CLONE_VFORK, 
+  rather than fork(). The child borrows the parent's memory until it
+  calls exec(), so there are no page tables to copy, and no copy-on-write
+  faults, however much private memory the daemon holds -- in particular
+  a framebuffer snapshot on the heap, which is where it goes if
+  memfd_create() is not available. (A snapshot in a memfd is a shared
+  mapping, whose page tables fork() would not copy either.) This is the
+  same technique that glibc uses to implement posix_spawn(), but doing
+  it ourselves lets us do the things that posix_spawn() can't, such as
+  asking to be traced. In return, the child must be careful: it can
+  only make system calls, and must not touch any of the parent's data
+  except to report an error. 
+
+  The screen-saver is placed in a process group of its own, whose ID is
+  the same as the screen-saver's PID. Signals are sent to the whole
+  group, so any helper processes that the screen-saver starts (for 
+  example, if it is a shell script) are stopped along with it. When 
+  the screen-saver process itself exits, any members of its group that
+  are left behind are killed, so they can't accumulate.
+
+  Scheduling settings -- nice value, policy, and CPU affinity -- are
+  applied by the child to itself, before it calls exec(), so the
+  screen-saver never runs with the daemon's priority, even briefly.
+
+  If a cgroup has been set, the child moves itself into it before
+  calling exec(), so every process the screen-saver creates is
+  accounted to it. When the child exits, the cgroup is emptied using
+  cgroup.kill, which catches even processes that have left the
+  process group, and its resource usage is logged.
+
+  Each child is given the write end of a pipe, whose number is passed
+  in the environment variable SAVER_NOTIFY_ENV, and on which it may
+  report "ready" when it has drawn its first frame, and "stopped" when
+  it will draw no more after being sent SIGTERM. The environment is
+  built here, before clone(), because the child can't safely allocate
+  memory. The pipe is close-on-exec everywhere except in the child,
+  which clears the flag on its own copy just before exec(). A snapshot
+  of the screen, if there is one, is passed the same way.
+
+  Supervision uses a pidfd where the kernel provides one (Linux 5.3 and
+  later). Otherwise, the caller is asked to call saver_process_service()
+  once a second while there is a child, which is no worse than the
+  way console-idle has always watched its input devices.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <klib/klib.h>
+#include "monotime.h"
+#include "saver_process.h"
+
+#define KLOG_CLASS "console_idle.saver_process"
+
+// How often to check on the child, when we have no pidfd
+#define FALLBACK_SERVICE_MS 1000
+
+// Most file descriptors, and environment variables, we pass to the child
+#define MAX_INHERIT_FDS 2
+#define MAX_VARS 4
+
+// Longest message we expect on the notification pipe
+#define NOTIFY_MAX 64
+
+// The status recorded for a child whose wait() status could not be
+//   collected. No real status has all these bits set
+#define STATUS_UNKNOWN -1
+
+// Stack for the child, which it only uses until it calls exec(). execvp()
+//   needs room for a copy of the longest path it will try
+#define CHILD_STACK_SIZE (64 * 1024)
+
+// Everything the child needs to know. The child shares our memory, so
+//   it can write its errno back here if exec() fails
+typedef struct _SaverChildArgs
+  {
+  char * const *argv;
+  char * const *envp;
+  BOOL traced;
+  int inherit_fds[MAX_INHERIT_FDS]; // To be left open across exec()
+  int ninherit;
+  int cgroup_fd; // cgroup.procs of the cgroup to join, or -1
+  BOOL set_nice;
+  int nice;
+  int policy; // -1 to leave unchanged
+  const cpu_set_t *cpus; // NULL to leave unchanged
+  // The first set-up step that failed in the child, if any
+  const char * volatile setup_step;
+  volatile int setup_errno;
+  sigset_t mask; // The signal mask to restore in the child
+  volatile int exec_errno;
+  } SaverChildArgs;
+
+struct _SaverProcess
+  {
+  int argc;
+  char * const *argv;
+  int grace; // Seconds between SIGTERM and SIGKILL
+  SaverCgroup *cgroup; // Not owned by this object; may be NULL
+  BOOL set_nice;
+  int nice;
+  int policy; // Scheduling policy, or -1 to inherit ours
+  BOOL set_cpus;
+  cpu_set_t cpus;
+  pid_t pid; // -1 when no child is associated with this object
+  int pidfd; // -1 if there is no child, or no kernel support
+  int notify_fd; // Read end of the notification pipe, or -1
+  char notify_buff[NOTIFY_MAX]; // Partial message from the child
+  int notify_len;
+  BOOL stopped; // Child has reported that it has stopped drawing
+  BOOL notifies; // Child has sent at least one message
+  int snapshot_fd; // Not owned by this object; -1 if there is none
+  int snapshot_w;
+  int snapshot_h;
+  BOOL prewarmed; // Child is stopped, waiting for saver_process_release()
+  int64_t start_ms; // When the child started running
+  int64_t kill_ms; // When to send SIGKILL, or zero if not terminating
+  int last_status; // wait() status of the last child to exit
+  int64_t last_runtime_ms; // How long the last child ran for
+  };
+
+/*============================================================================
+
+  saver_process_create
+
+  ==========================================================================*/
+SaverProcess *saver_process_create (int argc, char * const *argv, int grace)
+  {
+  KLOG_IN
+  SaverProcess *self = malloc (sizeof (SaverProcess));
+  self->argc = argc;
+  self->argv = argv;
+  self->grace = grace;
+  self->cgroup = NULL;
+  self->set_nice = FALSE;
+  self->nice = 0;
+  self->policy = -1;
+  self->set_cpus = FALSE;
+  self->pid = -1;
+  self->pidfd = -1;
+  self->notify_fd = -1;
+  self->notify_len = 0;
+  self->stopped = FALSE;
+  self->notifies = FALSE;
+  self->snapshot_fd = -1;
+  self->snapshot_w = 0;
+  self->snapshot_h = 0;
+  self->prewarmed = FALSE;
+  self->start_ms = 0;
+  self->kill_ms = 0;
+  self->last_status = -1;
+  self->last_runtime_ms = 0;
+  KLOG_OUT
+  return self;
+  }
+
+/*============================================================================
+
+  saver_process_destroy
+
+  ==========================================================================*/
+void saver_process_destroy (SaverProcess *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    if (self->pid > 0)
+      saver_process_discard (self);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_process_open_pidfd
+
+  ==========================================================================*/
+static int saver_process_open_pidfd (pid_t pid)
+  {
+#ifdef SYS_pidfd_open
+  int fd = syscall (SYS_pidfd_open, pid, 0);
+  if (fd < 0)
+    klog_debug (KLOG_CLASS, "pidfd_open() failed: %s", strerror (errno));
+  return fd;
+#else
+  return -1;
+#endif
+  }
+
+/*============================================================================
+
+  saver_process_forget
+
+  Record the exit of the child, whose wait() status has already been
+  collected; or STATUS_UNKNOWN if it could not be, because something 
+  else reaped the child. In that case the PID, and so the process
+  group, may already belong to some other process, and must not be
+  signalled.
+
+  ==========================================================================*/
+static void saver_process_forget (SaverProcess *self, int status)
+  {
+  self->last_status = status;
+  self->last_runtime_ms = monotime_ms() - self->start_ms;
+
+  double secs = self->last_runtime_ms / 1000.0;
+  if (status != STATUS_UNKNOWN)
+    {
+    if (WIFEXITED (status))
+      klog_info (KLOG_CLASS, "Screen-saver PID %d exited with status %d "
+        "after %.1f seconds", self->pid, WEXITSTATUS (status), secs);
+    else if (WIFSIGNALED (status))
+      klog_info (KLOG_CLASS, "Screen-saver PID %d killed by signal %d "
+        "after %.1f seconds", self->pid, WTERMSIG (status), secs);
+
+    // Don't leave helper processes behind
+    if (kill (-self->pid, SIGKILL) == 0)
+      klog_debug (KLOG_CLASS, "Killed any processes left in group %d", 
+        self->pid);
+    }
+  if (self->cgroup)
+    {
+    saver_cgroup_kill (self->cgroup);
+    saver_cgroup_report (self->cgroup);
+    }
+
+  if (self->pidfd >= 0) close (self->pidfd);
+  self->pidfd = -1;
+  if (self->notify_fd >= 0) close (self->notify_fd);
+  self->notify_fd = -1;
+  self->pid = -1;
+  self->prewarmed = FALSE;
+  self->kill_ms = 0;
+  }
+
+/*============================================================================
+
+  saver_process_signal
+
+  Send a signal to the screen-saver's process group or, if that fails, 
+  to the screen-saver process alone.
+
+  ==========================================================================*/
+static int saver_process_signal (const SaverProcess *self, int sig)
+  {
+  if (sig == SIGKILL && self->cgroup)
+    saver_cgroup_kill (self->cgroup);
+  int ret = kill (-self->pid, sig);
+  if (ret != 0 && errno == ESRCH)
+    ret = kill (self->pid, sig);
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_process_child_failed
+
+  Record a failure in the child, for the parent to log. Only the first
+  failure is kept.
+
+  ==========================================================================*/
+static void saver_process_child_failed (SaverChildArgs *args, 
+       const char *step)
+  {
+  if (!args->setup_step)
+    {
+    args->setup_step = step;
+    args->setup_errno = errno;
+    }
+  }
+
+/*============================================================================
+
+  saver_process_child
+
+  This function runs in the child, sharing the parent's memory, 
+  until exec() succeeds.
+
+  ==========================================================================*/
+static int saver_process_child (void *arg)
+  {
+  SaverChildArgs *args = arg;
+
+  // The child has its own copy of the signal dispositions. Any handlers
+  //   we inherited belong to the parent, and must not run here
+  for (int sig = 1; sig < _NSIG; sig++)
+    {
+    struct sigaction sa;
+    if (sigaction (sig, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN
+         && sa.sa_handler != SIG_DFL)
+      {
+      sa.sa_handler = SIG_DFL;
+      sigaction (sig, &sa, NULL);
+      }
+    }
+  sigprocmask (SIG_SETMASK, &args->mask, NULL);
+
+  setpgid (0, 0);
+  if (args->cgroup_fd >= 0 && write (args->cgroup_fd, "0", 1) < 0)
+    saver_process_child_failed (args, "move into cgroup");
+  if (args->set_nice && setpriority (PRIO_PROCESS, 0, args->nice) != 0)
+    saver_process_child_failed (args, "set nice value");
+  if (args->policy >= 0)
+    {
+    struct sched_param param;
+    param.sched_priority = 0;
+    if (sched_setscheduler (0, args->policy, &param) != 0)
+      saver_process_child_failed (args, "set scheduling policy");
+    }
+  if (args->cpus && 
+       sched_setaffinity (0, sizeof (cpu_set_t), args->cpus) != 0)
+    saver_process_child_failed (args, "set CPU affinity");
+  // This only affects the child's own copies of the descriptors
+  for (int i = 0; i < args->ninherit; i++)
+    {
+    if (fcntl (args->inherit_fds[i], F_SETFD, 0) != 0)
+      saver_process_child_failed (args, "pass file descriptor");
+    }
+  if (args->traced)
+    ptrace (PTRACE_TRACEME, 0, NULL, NULL);
+  execvpe (args->argv[0], args->argv, args->envp);
+  // We should never get here
+  args->exec_errno = errno;
+  _exit (127);
+  }
+
+/*============================================================================
+
+  saver_process_make_env
+
+  Make a copy of our environment for the child, with the nvars name=value 
+  strings in vars added, replacing any existing values for the same 
+  names. Only the array must be freed by the caller; the strings belong 
+  to the environment, and to the caller.
+
+  ==========================================================================*/
+static char **saver_process_make_env (int nvars, char * const *vars)
+  {
+  int n = 0;
+  while (environ[n]) n++;
+  char **envp = malloc ((n + nvars + 1) * sizeof (char *));
+  int j = 0;
+  for (int i = 0; i < n; i++)
+    {
+    BOOL replaced = FALSE;
+    for (int v = 0; v < nvars && !replaced; v++)
+      {
+      int name_len = strchr (vars[v], '=') - vars[v] + 1;
+      if (strncmp (environ[i], vars[v], name_len) == 0)
+        replaced = TRUE;
+      }
+    if (!replaced)
+      envp[j++] = environ[i];
+    }
+  for (int v = 0; v < nvars; v++)
+    envp[j++] = vars[v];
+  envp[j] = NULL;
+  return envp;
+  }
+
+/*============================================================================
+
+  saver_process_spawn
+
+  ==========================================================================*/
+static BOOL saver_process_spawn (SaverProcess *self, BOOL traced)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+
+  // Any previous child must be gone before we start another
+  if (self->pid > 0)
+    saver_process_discard (self);
+
+  klog_debug (KLOG_CLASS, "Executing command %s", self->argv[0]);
+
+  static BYTE child_stack [CHILD_STACK_SIZE] 
+    __attribute__ ((aligned (16)));
+
+  int notify_pipe[2] = { -1, -1 };
+  if (pipe2 (notify_pipe, O_CLOEXEC) == 0)
+    fcntl (notify_pipe[0], F_SETFL, O_NONBLOCK);
+  else
+    klog_warn (KLOG_CLASS, "Can't create notification pipe: %s", 
+      strerror (errno));
+
+  SaverChildArgs args;
+  args.ninherit = 0;
+  int nvars = 0;
+  char *vars[MAX_VARS];
+  if (notify_pipe[1] >= 0)
+    {
+    args.inherit_fds[args.ninherit++] = notify_pipe[1];
+    asprintf (&vars[nvars++], "%s=%d", SAVER_NOTIFY_ENV, notify_pipe[1]);
+    }
+  if (self->snapshot_fd >= 0)
+    {
+    args.inherit_fds[args.ninherit++] = self->snapshot_fd;
+    asprintf (&vars[nvars++], "%s=%d", SAVER_SNAPSHOT_FD_ENV, 
+      self->snapshot_fd);
+    asprintf (&vars[nvars++], "%s=%d", SAVER_SNAPSHOT_WIDTH_ENV, 
+      self->snapshot_w);
+    asprintf (&vars[nvars++], "%s=%d", SAVER_SNAPSHOT_HEIGHT_ENV, 
+      self->snapshot_h);
+    }
+  char **envp = saver_process_make_env (nvars, vars);
+
+  args.argv = self->argv;
+  args.envp = envp;
+  args.traced = traced;
+  args.cgroup_fd = self->cgroup ? saver_cgroup_get_procs_fd (self->cgroup)
+    : -1;
+  args.set_nice = self->set_nice;
+  args.nice = self->nice;
+  args.policy = self->policy;
+  args.cpus = self->set_cpus ? &self->cpus : NULL;
+  args.setup_step = NULL;
+  args.setup_errno = 0;
+  args.exec_errno = 0;
+
+  // Block all signals until the child has reset its handlers, or our
+  //   handlers could run in the child, on our memory
+  sigset_t all;
+  sigfillset (&all);
+  sigprocmask (SIG_BLOCK, &all, &args.mask);
+
+  // We are suspended here until the child has called exec(), or exited
+  pid_t pid = clone (saver_process_child, child_stack + CHILD_STACK_SIZE,
+     CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+
+  sigprocmask (SIG_SETMASK, &args.mask, NULL);
+
+  // The child has its own copy of the write end, if it wants it
+  if (notify_pipe[1] >= 0) close (notify_pipe[1]);
+  free (envp);
+  for (int v = 0; v < nvars; v++)
+    free (vars[v]);
+
+  if (pid > 0)
+    {
+    self->pid = pid;
+    self->pidfd = saver_process_open_pidfd (pid);
+    self->notify_fd = notify_pipe[0];
+    self->notify_len = 0;
+    self->stopped = FALSE;
+    self->notifies = FALSE;
+    self->start_ms = monotime_ms();
+    self->kill_ms = 0;
+    if (args.setup_step)
+      klog_warn (KLOG_CLASS, "Can't %s for PID %d: %s", args.setup_step,
+         pid, strerror (args.setup_errno));
+    if (args.exec_errno == 0)
+      {
+      ret = TRUE;
+      }
+    else
+      {
+      klog_error (KLOG_CLASS, "Can't execute %s: %s",
+         self->argv[0], strerror (args.exec_errno));
+      saver_process_discard (self);
+      }
+    }
+  else
+    {
+    klog_error (KLOG_CLASS, "Can't create process: %s", strerror (errno));
+    if (notify_pipe[0] >= 0) close (notify_pipe[0]);
+    }
+
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_process_set_command
+
+  ==========================================================================*/
+void saver_process_set_command (SaverProcess *self, int argc, 
+       char * const *argv)
+  {
+  self->argc = argc;
+  self->argv = argv;
+  }
+
+/*============================================================================
+
+  saver_process_set_cgroup
+
+  ==========================================================================*/
+void saver_process_set_cgroup (SaverProcess *self, SaverCgroup *cgroup)
+  {
+  self->cgroup = cgroup;
+  }
+
+/*============================================================================
+
+  saver_process_set_nice
+
+  ==========================================================================*/
+void saver_process_set_nice (SaverProcess *self, int nice)
+  {
+  self->set_nice = TRUE;
+  self->nice = nice;
+  }
+
+/*============================================================================
+
+  saver_process_set_policy
+
+  ==========================================================================*/
+void saver_process_set_policy (SaverProcess *self, int policy)
+  {
+  self->policy = policy;
+  }
+
+/*============================================================================
+
+  saver_process_set_cpus
+
+  ==========================================================================*/
+void saver_process_set_cpus (SaverProcess *self, const cpu_set_t *cpus)
+  {
+  self->set_cpus = TRUE;
+  memcpy (&self->cpus, cpus, sizeof (cpu_set_t));
+  }
+
+/*============================================================================
+
+  saver_process_set_snapshot
+
+  ==========================================================================*/
+void saver_process_set_snapshot (SaverProcess *self, int fd, int w, int h)
+  {
+  self->snapshot_fd = fd;
+  self->snapshot_w = w;
+  self->snapshot_h = h;
+  }
+
+/*============================================================================
+
+  saver_process_launch
+
+  ==========================================================================*/
+BOOL saver_process_launch (SaverProcess *self)
+  {
+  KLOG_IN
+  self->prewarmed = FALSE;
+  BOOL ret = saver_process_spawn (self, FALSE);
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_process_prewarm
+
+  ==========================================================================*/
+BOOL saver_process_prewarm (SaverProcess *self)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  self->prewarmed = FALSE;
+
+  if (saver_process_spawn (self, TRUE))
+    {
+    int status;
+    if (waitpid (self->pid, &status, 0) == self->pid)
+      {
+      if (WIFSTOPPED (status) && WSTOPSIG (status) == SIGTRAP)
+        {
+        // exec() has succeeded. Detach, leaving a SIGSTOP in place of the
+        //   SIGTRAP, so the child stays stopped when it is not traced
+        if (ptrace (PTRACE_DETACH, self->pid, NULL,
+             (void *)(long)SIGSTOP) == 0)
+          {
+          klog_debug (KLOG_CLASS, "Pre-warmed PID %d", self->pid);
+          self->prewarmed = TRUE;
+          ret = TRUE;
+          }
+        else
+          {
+          klog_warn (KLOG_CLASS, "Can't detach from PID %d: %s",
+            self->pid, strerror (errno));
+          saver_process_discard (self);
+          }
+        }
+      else
+        {
+        // Most likely exec() failed, and the child has exited
+        klog_warn (KLOG_CLASS, "Pre-warm of %s failed", self->argv[0]);
+        if (WIFEXITED (status) || WIFSIGNALED (status))
+          saver_process_forget (self, status);
+        else
+          saver_process_discard (self);
+        }
+      }
+    else
+      {
+      klog_warn (KLOG_CLASS, "Can't wait for PID %d: %s",
+        self->pid, strerror (errno));
+      saver_process_discard (self);
+      }
+    }
+
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_process_release
+
+  ==========================================================================*/
+BOOL saver_process_release (SaverProcess *self)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  if (self->pid > 0 && self->prewarmed)
+    {
+    klog_debug (KLOG_CLASS, "Releasing PID %d", self->pid);
+    if (saver_process_signal (self, SIGCONT) == 0)
+      ret = TRUE;
+    else
+      klog_warn (KLOG_CLASS, "Can't release PID %d: %s",
+        self->pid, strerror (errno));
+    self->prewarmed = FALSE;
+    self->start_ms = monotime_ms();
+    }
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_process_discard
+
+  ==========================================================================*/
+void saver_process_discard (SaverProcess *self)
+  {
+  KLOG_IN
+  if (self->pid > 0)
+    {
+    klog_debug (KLOG_CLASS, "Discarding PID %d", self->pid);
+    // SIGKILL is effective even on a stopped process
+    saver_process_signal (self, SIGKILL);
+    int status;
+    if (waitpid (self->pid, &status, 0) != self->pid)
+      status = STATUS_UNKNOWN;
+    saver_process_forget (self, status);
+    }
+  self->prewarmed = FALSE;
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_process_terminate
+
+  ==========================================================================*/
+void saver_process_terminate (SaverProcess *self)
+  {
+  KLOG_IN
+  if (self->pid > 0 && self->kill_ms == 0)
+    {
+    klog_debug (KLOG_CLASS, "Terminating PID %d", self->pid);
+    saver_process_signal (self, SIGTERM);
+    // A process that was never released must be continued, or it will
+    //   never act on the signal
+    if (self->prewarmed)
+      saver_process_signal (self, SIGCONT);
+    self->prewarmed = FALSE;
+    self->kill_ms = monotime_ms() + self->grace * 1000;
+    saver_process_service (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_process_notified
+
+  Act on one message from the child.
+
+  ==========================================================================*/
+static void saver_process_notified (SaverProcess *self, const char *msg)
+  {
+  self->notifies = TRUE;
+  if (strcmp (msg, "ready") == 0)
+    klog_debug (KLOG_CLASS, "PID %d ready after %d ms", self->pid,
+      (int)(monotime_ms() - self->start_ms));
+  else if (strcmp (msg, "stopped") == 0)
+    {
+    klog_debug (KLOG_CLASS, "PID %d has stopped drawing", self->pid);
+    self->stopped = TRUE;
+    }
+  else
+    klog_debug (KLOG_CLASS, "Unknown message '%s' from PID %d", 
+      msg, self->pid);
+  }
+
+/*============================================================================
+
+  saver_process_read_notify
+
+  Read whatever messages the child has sent. Messages are separated
+  by newlines; over-long ones are silently truncated. 
+
+  ==========================================================================*/
+static void saver_process_read_notify (SaverProcess *self)
+  {
+  char buff[256];
+  int n;
+  while ((n = read (self->notify_fd, buff, sizeof (buff))) > 0)
+    {
+    for (int i = 0; i < n; i++)
+      {
+      if (buff[i] == '\n')
+        {
+        self->notify_buff[self->notify_len] = 0;
+        saver_process_notified (self, self->notify_buff);
+        self->notify_len = 0;
+        }
+      else if (self->notify_len < NOTIFY_MAX - 1)
+        self->notify_buff[self->notify_len++] = buff[i];
+      }
+    }
+  if (n == 0)
+    {
+    // Nothing in the child's process group holds the pipe open any
+    //   more, and it would poll() as readable for ever
+    close (self->notify_fd);
+    self->notify_fd = -1;
+    }
+  }
+
+/*============================================================================
+
+  saver_process_service
+
+  ==========================================================================*/
+BOOL saver_process_service (SaverProcess *self)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  if (self->pid > 0)
+    {
+    if (self->notify_fd >= 0)
+      saver_process_read_notify (self);
+
+    int status;
+    pid_t pid = waitpid (self->pid, &status, WNOHANG);
+    if (pid == self->pid)
+      {
+      saver_process_forget (self, status);
+      ret = TRUE;
+      }
+    else if (pid < 0)
+      {
+      // Should not happen, unless something else reaped our child
+      klog_warn (KLOG_CLASS, "Lost track of PID %d: %s",
+        self->pid, strerror (errno));
+      saver_process_forget (self, STATUS_UNKNOWN);
+      ret = TRUE;
+      }
+    else if (self->kill_ms != 0 && monotime_ms() >= self->kill_ms)
+      {
+      klog_warn (KLOG_CLASS, "PID %d did not stop within %d seconds "
+        "-- killing it", self->pid, self->grace);
+      saver_process_discard (self);
+      ret = TRUE;
+      }
+    }
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_process_wait
+
+  ==========================================================================*/
+void saver_process_wait (SaverProcess *self)
+  {
+  KLOG_IN
+  while (self->pid > 0 && !self->prewarmed)
+    {
+    if (self->kill_ms == 0)
+      saver_process_terminate (self);
+    if (self->pid <= 0) break;
+
+    struct pollfd pfd;
+    pfd.fd = self->pidfd;
+    pfd.events = POLLIN;
+    poll (&pfd, self->pidfd >= 0 ? 1 : 0,
+      saver_process_get_wait_ms (self));
+    saver_process_service (self);
+    }
+  if (self->pid > 0)
+    saver_process_discard (self);
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_process_wait_stopped
+
+  ==========================================================================*/
+void saver_process_wait_stopped (SaverProcess *self)
+  {
+  KLOG_IN
+  while (self->pid > 0 && self->notifies && !self->stopped && 
+       self->kill_ms != 0)
+    {
+    struct pollfd pfd[2];
+    pfd[0].fd = self->pidfd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = self->notify_fd;
+    pfd[1].events = POLLIN;
+    poll (pfd, 2, saver_process_get_wait_ms (self));
+    saver_process_service (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_process_get_fd
+
+  ==========================================================================*/
+int saver_process_get_fd (const SaverProcess *self)
+  {
+  return self->pidfd;
+  }
+
+/*============================================================================
+
+  saver_process_get_notify_fd
+
+  ==========================================================================*/
+int saver_process_get_notify_fd (const SaverProcess *self)
+  {
+  return self->notify_fd;
+  }
+
+/*============================================================================
+
+  saver_process_get_wait_ms
+
+  ==========================================================================*/
+int saver_process_get_wait_ms (const SaverProcess *self)
+  {
+  if (self->pid <= 0) return -1;
+  int ret = -1;
+  if (self->kill_ms != 0)
+    ret = monotime_ms_until (self->kill_ms);
+  if (self->pidfd < 0 && (ret < 0 || ret > FALLBACK_SERVICE_MS))
+    ret = FALLBACK_SERVICE_MS;
+  return ret;
+  }
+
+/*============================================================================
+
+  saver_process_is_terminating
+
+  ==========================================================================*/
+BOOL saver_process_is_terminating (const SaverProcess *self)
+  {
+  return self->pid > 0 && self->kill_ms != 0;
+  }
+
+/*============================================================================
+
+  saver_process_get_last_status
+
+  ==========================================================================*/
+int saver_process_get_last_status (const SaverProcess *self)
+  {
+  return self->last_status;
+  }
+
+/*============================================================================
+
+  saver_process_get_last_runtime_ms
+
+  ==========================================================================*/
+int64_t saver_process_get_last_runtime_ms (const SaverProcess *self)
+  {
+  return self->last_runtime_ms;
+  }
+
+/*============================================================================
+
+  saver_process_is_active
+
+  ==========================================================================*/
+BOOL saver_process_is_active (const SaverProcess *self)
+  {
+  return self->pid > 0;
+  }
+
+/*============================================================================
+
+  saver_process_is_prewarmed
+
+  ==========================================================================*/
+BOOL saver_process_is_prewarmed (const SaverProcess *self)
+  {
+  return self->pid > 0 && self->prewarmed;
+  }
+
+/*============================================================================
+
+  saver_process_get_pid
+
+  ==========================================================================*/
+pid_t saver_process_get_pid (const SaverProcess *self)
+  {
+  return self->pid;
+  }
+
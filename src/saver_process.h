@@ -0,0 +1,186 @@
+/*============================================================================
+
+  console-idle
+
+  saver_process.h
+
+  A "class" that represents one run of the external screen-saver program.
+  The usual sequence of operations is
+
+  saver_process_create
+  saver_process_launch (or saver_process_prewarm, then
+    saver_process_release)
+  saver_process_terminate (or saver_process_discard)
+  saver_process_service (whenever the supervision fd is readable, or
+    the supervision timeout expires)
+  saver_process_destroy
+
+  A SaverProcess can be launched any number of times, but only one
+  child process is associated with it at any one time.
+
+  Supervision is driven by the caller's event loop. Where the kernel
+  supports it, the object holds a pidfd for the child, which becomes
+  readable when the child exits; the caller adds this to its poll()
+  set. After saver_process_terminate(), the child is given a grace 
+  period to exit, after which it is sent SIGKILL. The caller should
+  limit its poll() timeout using saver_process_get_wait_ms(), so that
+  the escalation happens on time.
+
+  The screen-saver may, optionally, report its progress. The number of
+  a file descriptor is passed to it in the environment variable 
+  SAVER_NOTIFY_ENV, and the screen-saver can write the following 
+  messages to it, each followed by a newline:
+
+  ready -- the first frame has been drawn
+  stopped -- after SIGTERM, no more output will be drawn
+
+  A screen-saver that sends either message is expected to send
+  "stopped" promptly after SIGTERM, so the caller can restore the
+  screen without waiting for the program to exit. The caller should
+  add saver_process_get_notify_fd() to its poll() set, and call
+  saver_process_service() when it is readable.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <sched.h>
+#include <sys/types.h>
+#include <klib/klib.h>
+#include "saver_cgroup.h"
+
+// The environment variable that holds the notification fd number
+#define SAVER_NOTIFY_ENV "CONSOLE_IDLE_NOTIFY_FD"
+// The environment variables that describe the screen snapshot
+#define SAVER_SNAPSHOT_FD_ENV "CONSOLE_IDLE_SNAPSHOT_FD"
+#define SAVER_SNAPSHOT_WIDTH_ENV "CONSOLE_IDLE_SNAPSHOT_WIDTH"
+#define SAVER_SNAPSHOT_HEIGHT_ENV "CONSOLE_IDLE_SNAPSHOT_HEIGHT"
+
+struct _SaverProcess;
+typedef struct _SaverProcess SaverProcess;
+
+BEGIN_DECLS
+
+/** Create a new SaverProcess for the specified command line. The
+    argument array is not copied, and must remain valid until the
+    object is destroyed. grace is the time, in seconds, that the 
+    screen-saver is allowed to spend shutting down before it is killed. */
+SaverProcess  *saver_process_create (int argc, char * const *argv, 
+                  int grace);
+
+/** Change the command line that will be used the next time the
+    screen-saver is launched. As with saver_process_create(), the
+    argument array is not copied. */
+void           saver_process_set_command (SaverProcess *self, int argc, 
+                  char * const *argv);
+
+/** Destroy this object. Any child process that is still running is
+    discarded. */
+void           saver_process_destroy (SaverProcess *self);
+
+/** Run the screen-saver in the specified cgroup, which must already
+    have been initialized. The cgroup is not owned by this object, and
+    must remain valid until it is destroyed. */
+void           saver_process_set_cgroup (SaverProcess *self, 
+                  SaverCgroup *cgroup);
+
+/** Set the nice value for the screen-saver. If this is not called, the
+    screen-saver inherits console-idle's own nice value. */
+void           saver_process_set_nice (SaverProcess *self, int nice);
+
+/** Set the scheduling policy for the screen-saver -- usually SCHED_IDLE
+    or SCHED_BATCH. If this is not called, the screen-saver inherits
+    console-idle's own policy. */
+void           saver_process_set_policy (SaverProcess *self, int policy);
+
+/** Restrict the screen-saver to the specified set of CPUs. */
+void           saver_process_set_cpus (SaverProcess *self, 
+                  const cpu_set_t *cpus);
+
+/** Pass a snapshot of the screen to the screen-saver, as the file
+    descriptor fd, which holds w x h pixels. The descriptor is not 
+    owned by this object, and must remain open until the screen-saver
+    has been launched. Its number, and the size of the snapshot, are
+    passed in the environment. Set fd to -1 to pass no snapshot. */
+void           saver_process_set_snapshot (SaverProcess *self, int fd,
+                  int w, int h);
+
+/** Start the screen-saver program in the usual way. */
+BOOL           saver_process_launch (SaverProcess *self);
+
+/** Start the screen-saver program, but leave it stopped immediately
+    after its exec() has completed. No code from the screen-saver
+    program itself will have run at this point. The process can be
+    set running using saver_process_release(), or killed using
+    saver_process_discard(). Returns FALSE if the program could not be
+    started. */
+BOOL           saver_process_prewarm (SaverProcess *self);
+
+/** Set a pre-warmed screen-saver running. */
+BOOL           saver_process_release (SaverProcess *self);
+
+/** Kill a pre-warmed (or running) screen-saver program without ceremony,
+    and reap it. */
+void           saver_process_discard (SaverProcess *self);
+
+/** Ask the screen-saver program to stop, by sending it a TERM signal. 
+    This method does not wait for the program to stop; if it is still
+    running when the grace period expires, saver_process_service() will
+    kill it. */
+void           saver_process_terminate (SaverProcess *self);
+
+/** Block until the child process, if any, has exited, killing it if
+    it outlives the grace period. */
+void           saver_process_wait (SaverProcess *self);
+
+/** Reap the child if it has exited, and kill it if it has overstayed its
+    grace period after termination. This method never blocks. Returns
+    TRUE if the child exited during this call. */
+BOOL           saver_process_service (SaverProcess *self);
+
+/** After saver_process_terminate(), block until the screen-saver has 
+    reported that it has stopped drawing, or has exited, or has been 
+    killed at the end of the grace period. If the screen-saver has not
+    sent any notifications, it is assumed not to support them, and this
+    method returns at once. */
+void           saver_process_wait_stopped (SaverProcess *self);
+
+/** Get a file descriptor that becomes readable when the child process
+    exits, or -1 if there is no child, or the kernel can't provide one. */
+int            saver_process_get_fd (const SaverProcess *self);
+
+/** Get a file descriptor that becomes readable when the child process
+    sends a notification, or -1 if there is none. */
+int            saver_process_get_notify_fd (const SaverProcess *self);
+
+/** Get the longest time, in milliseconds, that the caller may wait before
+    calling saver_process_service(). -1 means that the caller need not
+    call it at all, unless the fd becomes readable. */
+int            saver_process_get_wait_ms (const SaverProcess *self);
+
+/** Returns TRUE if the child process has been sent a TERM signal, but
+    has not yet exited. */
+BOOL           saver_process_is_terminating (const SaverProcess *self);
+
+/** Get the wait() status of the most recent child process to exit, or
+    -1 if none has exited, or its status could not be collected. */
+int            saver_process_get_last_status (const SaverProcess *self);
+
+/** Get the time, in milliseconds, for which the most recent child 
+    process to exit was running. */
+int64_t        saver_process_get_last_runtime_ms (const SaverProcess *self);
+
+/** Returns TRUE if a child process is associated with this object, whether
+    it is running or stopped. */
+BOOL           saver_process_is_active (const SaverProcess *self);
+
+/** Returns TRUE if the child process has been pre-warmed, and not yet
+    released. */
+BOOL           saver_process_is_prewarmed (const SaverProcess *self);
+
+pid_t          saver_process_get_pid (const SaverProcess *self);
+
+END_DECLS
+
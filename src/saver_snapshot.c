@@ -0,0 +1,240 @@
+/*============================================================================
+
+  console-idle
+
+  saver_snapshot.c
+
+  Each capture uses a new memfd, because a sealed memfd can never be
+  written again, and a screen-saver from an earlier cycle might still
+  have the old one mapped. The memfd is created by 
+  saver_snapshot_prepare(), so that its number is known before a 
+  pre-warmed screen-saver is started; the pre-warmed process can't 
+  run until after the capture, so it never sees an incomplete 
+  snapshot. The snapshot is written through a shared
+  writable mapping, which must then be removed before the kernel will
+  accept a write seal; the daemon keeps a read-only mapping of the same
+  pages for restoring the screen. So there is only ever one copy of the
+  snapshot in memory, however many processes are looking at it.
+
+  If memfd_create() is not available, the snapshot is kept in an
+  ordinary bitmap, and is not shared.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <klib/klib.h>
+#include "saver_snapshot.h"
+
+#define KLOG_CLASS "console_idle.saver_snapshot"
+
+// Bytes per pixel in the snapshot, as for BitmapRGB
+#define SNAPSHOT_BPP 3
+
+struct _SaverSnapshot
+  {
+  int w;
+  int h;
+  int fd; // The current memfd, or -1
+  BOOL sealed; // TRUE if fd holds a complete snapshot
+  BYTE *map; // Read-only mapping of fd, or NULL
+  BitmapRGB *bitmap; // Wraps map, or owns its own memory if fd < 0
+  };
+
+/*============================================================================
+
+  saver_snapshot_create
+
+  ==========================================================================*/
+SaverSnapshot *saver_snapshot_create (int w, int h)
+  {
+  KLOG_IN
+  SaverSnapshot *self = malloc (sizeof (SaverSnapshot));
+  self->w = w;
+  self->h = h;
+  self->fd = -1;
+  self->sealed = FALSE;
+  self->map = NULL;
+  self->bitmap = NULL;
+  KLOG_OUT
+  return self;
+  }
+
+/*============================================================================
+
+  saver_snapshot_release
+
+  Discard the current snapshot, if there is one.
+
+  ==========================================================================*/
+static void saver_snapshot_release (SaverSnapshot *self)
+  {
+  if (self->bitmap) bitmaprgb_destroy (self->bitmap);
+  self->bitmap = NULL;
+  if (self->map) 
+    munmap (self->map, (size_t)self->w * self->h * SNAPSHOT_BPP);
+  self->map = NULL;
+  if (self->fd >= 0) close (self->fd);
+  self->fd = -1;
+  self->sealed = FALSE;
+  }
+
+/*============================================================================
+
+  saver_snapshot_destroy
+
+  ==========================================================================*/
+void saver_snapshot_destroy (SaverSnapshot *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    saver_snapshot_release (self);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_snapshot_prepare
+
+  ==========================================================================*/
+void saver_snapshot_prepare (SaverSnapshot *self)
+  {
+  KLOG_IN
+  if (self->fd < 0 || self->sealed)
+    {
+    saver_snapshot_release (self);
+    int fd = memfd_create ("console-idle-snapshot",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd >= 0)
+      {
+      if (ftruncate (fd, (size_t)self->w * self->h * SNAPSHOT_BPP) == 0)
+        self->fd = fd;
+      else
+        {
+        klog_warn (KLOG_CLASS, "Can't allocate snapshot: %s", 
+          strerror (errno));
+        close (fd);
+        }
+      }
+    else
+      klog_debug (KLOG_CLASS, "memfd_create() failed: %s", strerror (errno));
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_snapshot_capture_shared
+
+  Capture the framebuffer into the prepared memfd, and seal it. Returns 
+  FALSE if this can't be done, having cleaned up.
+
+  ==========================================================================*/
+static BOOL saver_snapshot_capture_shared (SaverSnapshot *self,
+       const FrameBuffer *fb)
+  {
+  size_t size = (size_t)self->w * self->h * SNAPSHOT_BPP;
+  int fd = self->fd;
+  BYTE *data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    {
+    klog_warn (KLOG_CLASS, "Can't map snapshot: %s", strerror (errno));
+    saver_snapshot_release (self);
+    return FALSE;
+    }
+
+  BitmapRGB *bitmap = bitmaprgb_create_for_data (self->w, self->h, data);
+  bitmaprgb_from_fb (bitmap, fb, 0, 0);
+  bitmaprgb_destroy (bitmap);
+  munmap (data, size);
+
+  if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE
+       | F_SEAL_SEAL) != 0)
+    klog_warn (KLOG_CLASS, "Can't seal snapshot: %s", strerror (errno));
+
+  data = mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    {
+    klog_warn (KLOG_CLASS, "Can't map snapshot: %s", strerror (errno));
+    saver_snapshot_release (self);
+    return FALSE;
+    }
+
+  self->sealed = TRUE;
+  self->map = data;
+  self->bitmap = bitmaprgb_create_for_data (self->w, self->h, data);
+  return TRUE;
+  }
+
+/*============================================================================
+
+  saver_snapshot_capture
+
+  ==========================================================================*/
+void saver_snapshot_capture (SaverSnapshot *self, const FrameBuffer *fb)
+  {
+  KLOG_IN
+  saver_snapshot_prepare (self);
+  if (self->fd < 0 || !saver_snapshot_capture_shared (self, fb))
+    {
+    if (self->bitmap) bitmaprgb_destroy (self->bitmap);
+    self->bitmap = bitmaprgb_create (self->w, self->h);
+    if (self->bitmap)
+      bitmaprgb_from_fb (self->bitmap, fb, 0, 0);
+    else
+      klog_warn (KLOG_CLASS, "Not enough memory for a snapshot");
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  saver_snapshot_get_bitmap
+
+  ==========================================================================*/
+const BitmapRGB *saver_snapshot_get_bitmap (const SaverSnapshot *self)
+  {
+  return self->bitmap;
+  }
+
+/*============================================================================
+
+  saver_snapshot_get_fd
+
+  ==========================================================================*/
+int saver_snapshot_get_fd (const SaverSnapshot *self)
+  {
+  return self->fd;
+  }
+
+/*============================================================================
+
+  saver_snapshot_get_width
+
+  ==========================================================================*/
+int saver_snapshot_get_width (const SaverSnapshot *self)
+  {
+  return self->w;
+  }
+
+/*============================================================================
+
+  saver_snapshot_get_height
+
+  ==========================================================================*/
+int saver_snapshot_get_height (const SaverSnapshot *self)
+  {
+  return self->h;
+  }
+
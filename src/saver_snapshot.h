@@ -0,0 +1,69 @@
+/*============================================================================
+
+  console-idle
+
+  saver_snapshot.h
+
+  A "class" that holds the copy of the screen that is taken before the
+  screen-saver starts, and restored when it stops. The usual sequence of
+  operations is
+
+  saver_snapshot_create
+  saver_snapshot_prepare (before the screen-saver is launched or
+    pre-warmed)
+  saver_snapshot_capture (each time the screen-saver is to start)
+  saver_snapshot_get_fd (to pass the snapshot to the screen-saver)
+  saver_snapshot_get_bitmap (to restore the screen)
+  saver_snapshot_destroy
+
+  Where the kernel allows, the snapshot is held in a sealed memfd,
+  which the screen-saver can map for itself, and which can't be changed
+  once it has been captured. The pixels are three bytes each, in the
+  order b,g,r, with no padding at the ends of rows.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+
+struct _SaverSnapshot;
+typedef struct _SaverSnapshot SaverSnapshot;
+
+BEGIN_DECLS
+
+/** Create a new SaverSnapshot for a screen of w x h pixels. No memory
+    is allocated for the pixels until the first capture. */
+SaverSnapshot *saver_snapshot_create (int w, int h);
+
+void           saver_snapshot_destroy (SaverSnapshot *self);
+
+/** Make ready for a new snapshot, so that saver_snapshot_get_fd() 
+    returns the descriptor that the next capture will use. Any previous
+    snapshot is discarded, although a screen-saver that has it mapped 
+    may go on using it. */
+void           saver_snapshot_prepare (SaverSnapshot *self);
+
+/** Copy the contents of the framebuffer, which must already be
+    initialized, into a new snapshot, preparing one first if
+    necessary. */
+void           saver_snapshot_capture (SaverSnapshot *self,
+                  const FrameBuffer *fb);
+
+/** Get the most recent snapshot, as a bitmap that must not be modified,
+    or NULL if there is none. */
+const BitmapRGB *saver_snapshot_get_bitmap (const SaverSnapshot *self);
+
+/** Get a file descriptor for the most recent (or prepared) snapshot,
+    which another process can mmap() for reading, or -1 if the snapshot
+    can't be shared. The descriptor is close-on-exec, and belongs to 
+    this object. */
+int            saver_snapshot_get_fd (const SaverSnapshot *self);
+
+int            saver_snapshot_get_width (const SaverSnapshot *self);
+int            saver_snapshot_get_height (const SaverSnapshot *self);
+
+END_DECLS
+
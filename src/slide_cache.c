@@ -0,0 +1,323 @@
+/*============================================================================
+
+  console-idle
+
+  slide_cache.c
+
+  All the state is protected by one mutex, which is never held while an
+  image is being loaded, so the caller is never held up for longer than
+  it takes to copy an image. Requests are held in a small queue; if it
+  overflows, the oldest request is dropped, since the caller has
+  evidently moved on.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <klib/klib.h>
+#include "slide_cache.h"
+
+#define KLOG_CLASS "console_idle.slide_cache"
+
+#define QUEUE_MAX 8
+
+typedef struct _Slide
+  {
+  char *file;
+  SlideState state;
+  BitmapRGB *bitmap; // Only when state is SLIDE_READY, and bpp is 0
+  BitmapFB *frame; // Only when state is SLIDE_READY, and bpp is not 0
+  size_t size; // Bytes used by bitmap or frame
+  uint64_t used; // Value of the use counter when last used
+  } Slide;
+
+struct _SlideCache
+  {
+  int nslides;
+  Slide *slides;
+  int w;
+  int h;
+  int bpp; // Of frames, or 0 to keep BitmapRGBs
+  BitmapRGBDither dither;
+  KThreadPool *pool; // Not owned by this object; may be NULL
+  size_t budget;
+  size_t total; // Bytes used by loaded images
+  uint64_t use_counter;
+  int queue[QUEUE_MAX];
+  int queue_start;
+  int queue_len;
+  BOOL quit;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_t thread;
+  };
+
+/*============================================================================
+
+  slide_cache_evict
+
+  Discard the least recently used images until the total is within the
+  budget. Must be called with the mutex held.
+
+  ==========================================================================*/
+static void slide_cache_evict (SlideCache *self, int keep)
+  {
+  while (self->total > self->budget)
+    {
+    Slide *oldest = NULL;
+    for (int i = 0; i < self->nslides; i++)
+      {
+      Slide *s = &self->slides[i];
+      if (i != keep && s->state == SLIDE_READY &&
+           (!oldest || s->used < oldest->used))
+        oldest = s;
+      }
+    if (!oldest) break;
+    klog_debug (KLOG_CLASS, "Discarding %s", oldest->file);
+    bitmaprgb_destroy (oldest->bitmap);
+    oldest->bitmap = NULL;
+    bitmapfb_destroy (oldest->frame);
+    oldest->frame = NULL;
+    oldest->state = SLIDE_NONE;
+    self->total -= oldest->size;
+    }
+  }
+
+/*============================================================================
+
+  slide_cache_thread
+
+  ==========================================================================*/
+static void *slide_cache_thread (void *arg)
+  {
+  SlideCache *self = arg;
+  pthread_mutex_lock (&self->mutex);
+  while (!self->quit)
+    {
+    if (self->queue_len == 0)
+      {
+      pthread_cond_wait (&self->cond, &self->mutex);
+      continue;
+      }
+    int index = self->queue[self->queue_start];
+    self->queue_start = (self->queue_start + 1) % QUEUE_MAX;
+    self->queue_len--;
+    Slide *slide = &self->slides[index];
+    pthread_mutex_unlock (&self->mutex);
+
+    char *error = NULL;
+    BitmapRGB *bitmap = NULL;
+    BitmapFB *frame = NULL;
+    BitmapRGB *image = bitmaprgb_load_scaled (slide->file, self->w,
+      self->h, &error);
+    if (image)
+      {
+      bitmap = bitmaprgb_create (self->w, self->h);
+      if (bitmap)
+        bitmaprgb_scale_into_tiled (bitmap, image, BITMAPRGB_FILTER_AREA,
+          BITMAPRGB_SCALE_LETTERBOX, self->pool);
+      bitmaprgb_destroy (image);
+      if (bitmap && self->bpp)
+        {
+        frame = bitmapfb_create (self->w, self->h, self->bpp);
+        if (frame)
+          bitmapfb_from_bitmaprgb_tiled (frame, bitmap, 0, 0, self->w,
+            self->h, self->dither, self->pool);
+        bitmaprgb_destroy (bitmap);
+        bitmap = NULL;
+        }
+      if (bitmap || frame)
+        klog_debug (KLOG_CLASS, "Loaded %s", slide->file);
+      else
+        klog_warn (KLOG_CLASS, "Not enough memory for %s", slide->file);
+      }
+    else
+      {
+      klog_warn (KLOG_CLASS, "%s", error);
+      free (error);
+      }
+
+    pthread_mutex_lock (&self->mutex);
+    if (bitmap || frame)
+      {
+      slide->bitmap = bitmap;
+      slide->frame = frame;
+      slide->size = frame ? (size_t)bitmapfb_get_stride (frame) * self->h
+        : (size_t)self->w * self->h * 3;
+      slide->state = SLIDE_READY;
+      slide->used = ++self->use_counter;
+      self->total += slide->size;
+      slide_cache_evict (self, index);
+      }
+    else
+      slide->state = SLIDE_FAILED;
+    }
+  pthread_mutex_unlock (&self->mutex);
+  return NULL;
+  }
+
+/*============================================================================
+
+  slide_cache_create
+
+  ==========================================================================*/
+SlideCache *slide_cache_create (int nfiles, char * const *files,
+       int w, int h, int bits_per_pixel, BitmapRGBDither dither,
+       KThreadPool *pool, size_t budget)
+  {
+  KLOG_IN
+  SlideCache *self = malloc (sizeof (SlideCache));
+  self->nslides = nfiles;
+  self->slides = calloc (nfiles, sizeof (Slide));
+  for (int i = 0; i < nfiles; i++)
+    self->slides[i].file = strdup (files[i]);
+  self->w = w;
+  self->h = h;
+  self->bpp = bits_per_pixel;
+  self->dither = dither;
+  self->pool = pool;
+  self->budget = budget;
+  self->total = 0;
+  self->use_counter = 0;
+  self->queue_start = 0;
+  self->queue_len = 0;
+  self->quit = FALSE;
+  pthread_mutex_init (&self->mutex, NULL);
+  pthread_cond_init (&self->cond, NULL);
+  int err = pthread_create (&self->thread, NULL, slide_cache_thread, self);
+  if (err != 0)
+    {
+    klog_error (KLOG_CLASS, "Can't start thread: %s", strerror (err));
+    self->quit = TRUE;
+    slide_cache_destroy (self);
+    self = NULL;
+    }
+  KLOG_OUT
+  return self;
+  }
+
+/*============================================================================
+
+  slide_cache_destroy
+
+  ==========================================================================*/
+void slide_cache_destroy (SlideCache *self)
+  {
+  KLOG_IN
+  if (self)
+    {
+    if (!self->quit)
+      {
+      pthread_mutex_lock (&self->mutex);
+      self->quit = TRUE;
+      pthread_cond_signal (&self->cond);
+      pthread_mutex_unlock (&self->mutex);
+      pthread_join (self->thread, NULL);
+      }
+    for (int i = 0; i < self->nslides; i++)
+      {
+      free (self->slides[i].file);
+      if (self->slides[i].bitmap) bitmaprgb_destroy (self->slides[i].bitmap);
+      bitmapfb_destroy (self->slides[i].frame);
+      }
+    free (self->slides);
+    pthread_cond_destroy (&self->cond);
+    pthread_mutex_destroy (&self->mutex);
+    free (self);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  slide_cache_request
+
+  ==========================================================================*/
+void slide_cache_request (SlideCache *self, int index)
+  {
+  KLOG_IN
+  if (index >= 0 && index < self->nslides)
+    {
+    pthread_mutex_lock (&self->mutex);
+    Slide *slide = &self->slides[index];
+    if (slide->state == SLIDE_NONE)
+      {
+      if (self->queue_len == QUEUE_MAX)
+        {
+        self->slides[self->queue[self->queue_start]].state = SLIDE_NONE;
+        self->queue_start = (self->queue_start + 1) % QUEUE_MAX;
+        self->queue_len--;
+        }
+      self->queue[(self->queue_start + self->queue_len) % QUEUE_MAX] = index;
+      self->queue_len++;
+      slide->state = SLIDE_PENDING;
+      pthread_cond_signal (&self->cond);
+      }
+    pthread_mutex_unlock (&self->mutex);
+    }
+  KLOG_OUT
+  }
+
+/*============================================================================
+
+  slide_cache_get_state
+
+  ==========================================================================*/
+SlideState slide_cache_get_state (SlideCache *self, int index)
+  {
+  pthread_mutex_lock (&self->mutex);
+  SlideState ret = self->slides[index].state;
+  pthread_mutex_unlock (&self->mutex);
+  return ret;
+  }
+
+/*============================================================================
+
+  slide_cache_copy
+
+  ==========================================================================*/
+BOOL slide_cache_copy (SlideCache *self, int index, BitmapRGB *bitmap)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  pthread_mutex_lock (&self->mutex);
+  Slide *slide = &self->slides[index];
+  if (slide->state == SLIDE_READY && slide->bitmap)
+    {
+    bitmaprgb_copy_from (bitmap, slide->bitmap);
+    slide->used = ++self->use_counter;
+    ret = TRUE;
+    }
+  pthread_mutex_unlock (&self->mutex);
+  KLOG_OUT
+  return ret;
+  }
+
+/*============================================================================
+
+  slide_cache_copy_frame
+
+  ==========================================================================*/
+BOOL slide_cache_copy_frame (SlideCache *self, int index, BitmapFB *frame)
+  {
+  KLOG_IN
+  BOOL ret = FALSE;
+  pthread_mutex_lock (&self->mutex);
+  Slide *slide = &self->slides[index];
+  if (slide->state == SLIDE_READY && slide->frame)
+    {
+    bitmapfb_copy_from (frame, slide->frame);
+    slide->used = ++self->use_counter;
+    ret = TRUE;
+    }
+  pthread_mutex_unlock (&self->mutex);
+  KLOG_OUT
+  return ret;
+  }
+
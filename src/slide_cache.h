@@ -0,0 +1,79 @@
+/*============================================================================
+
+  console-idle
+
+  slide_cache.h
+
+  A "class" that loads a list of image files, scaled to fit a given
+  size, on a background thread. The caller asks for images it will
+  want soon with slide_cache_request(), and later copies them out with
+  slide_cache_copy(), which never waits for an image to load.
+
+  Images can also be converted to the framebuffer's pixel format, on
+  the same thread, so that showing one is nothing but copying.
+
+  Loaded images are kept until the memory they use exceeds a budget,
+  and then the least recently used are discarded; so a short list of
+  images that is shown over and over is loaded only once.
+
+  Copyright (c)1990-2020 Kevin Boone. Distributed under the terms of the
+  GNU Public Licence, v3.0
+
+  ==========================================================================*/
+#pragma once
+
+#include <klib/klib.h>
+
+typedef enum
+  {
+  // Not loaded, and not requested, or discarded from the cache
+  SLIDE_NONE = 0,
+  // Waiting to be loaded, or being loaded
+  SLIDE_PENDING,
+  SLIDE_READY,
+  // Could not be loaded -- there's no point asking again
+  SLIDE_FAILED
+  } SlideState;
+
+struct _SlideCache;
+typedef struct _SlideCache SlideCache;
+
+BEGIN_DECLS
+
+/** Create the cache, and start its thread. The list of files is
+    copied. Images are scaled to w x h pixels, and the memory used by
+    loaded images is kept below budget bytes, except that the most
+    recently loaded image is always kept. If bits_per_pixel is not 
+    zero, images are then converted to BitmapFBs of that depth, using
+    the specified dither, and must be copied out with 
+    slide_cache_copy_frame(). The scaling and converting are shared 
+    between the threads of pool, if it is not NULL, which must last
+    as long as the cache. Returns NULL if the thread can't be 
+    started. */
+SlideCache    *slide_cache_create (int nfiles, char * const *files,
+                  int w, int h, int bits_per_pixel, 
+                  BitmapRGBDither dither, KThreadPool *pool, 
+                  size_t budget);
+
+/** Stop the thread, which may have to wait for an image to finish
+    loading, and free everything. */
+void           slide_cache_destroy (SlideCache *self);
+
+/** Ask for an image to be loaded, if it is not loaded already. Requests
+    are handled in the order they are made. */
+void           slide_cache_request (SlideCache *self, int index);
+
+SlideState     slide_cache_get_state (SlideCache *self, int index);
+
+/** If the image is loaded, copy it to the bitmap, which must be the
+    size given to slide_cache_create(), and return TRUE. */
+BOOL           slide_cache_copy (SlideCache *self, int index,
+                  BitmapRGB *bitmap);
+
+/** As slide_cache_copy(), for a cache created with a bits_per_pixel,
+    to a BitmapFB of that size and depth. */
+BOOL           slide_cache_copy_frame (SlideCache *self, int index,
+                  BitmapFB *frame);
+
+END_DECLS
+